@@ -0,0 +1,415 @@
+/*
+bench [scale [runs]]
+Prints one CSV row per measure, see print_row()
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ctpool.h>
+
+#define MODES_NUM 3U
+#define COUNTS_NUM 3U
+
+struct sample_t {
+    unsigned long long submit;
+    unsigned long long start;
+};
+
+struct producer_t {
+    ctpool_t pool;
+    unsigned int count;
+};
+
+static const char* const mode_names[MODES_NUM] = {
+    "mutex", "lock_free", "stealing"
+};
+static const unsigned int counts[COUNTS_NUM] = { 1U, 2U, 4U };
+
+static unsigned int scale = 1U;
+static unsigned int runs = 3U;
+static atomic_uint stamped;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL)
+           + (unsigned long long)ts.tv_nsec;
+}
+
+static void spin_ns(unsigned long long ns)
+{
+    const unsigned long long start = now_ns();
+    while ((now_ns() - start) < ns) {
+    }
+}
+
+static void* empty(void* arg)
+{
+    (void)arg;
+    return NULL;
+}
+
+static void* short_work(void* arg)
+{
+    (void)arg;
+    spin_ns(1000U);
+    return NULL;
+}
+
+static void* long_work(void* arg)
+{
+    (void)arg;
+    spin_ns(100000U);
+    return NULL;
+}
+
+static void* overload_work(void* arg)
+{
+    (void)arg;
+    spin_ns(2000U);
+    return NULL;
+}
+
+static void* stamp(void* arg)
+{
+    struct sample_t* const s = (struct sample_t*)arg;
+    s->start = now_ns();
+    atomic_fetch_add(&stamped, 1U);
+    return NULL;
+}
+
+static void wait_stamped(unsigned int n)
+{
+    while (atomic_load(&stamped) < n) {
+        sched_yield();
+    }
+}
+
+static void* produce(void* arg)
+{
+    const struct producer_t* const pr = (const struct producer_t*)arg;
+    unsigned int i;
+
+    for (i = 0U; i < pr->count; i++) {
+        ctp_add_work(pr->pool, empty, NULL);
+    }
+
+    return NULL;
+}
+
+static int compare_ull(const void* a, const void* b)
+{
+    const unsigned long long x = *(const unsigned long long*)a;
+    const unsigned long long y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+static ctpool_t make_pool(unsigned int mode, unsigned int threads,
+                          unsigned int queue_size, int block, int caller_runs)
+{
+    ctp_options_t options;
+
+    ctp_options_init(&options);
+    options.threads_num = threads;
+    options.queue_size = queue_size;
+    options.block = block;
+    options.caller_runs = caller_runs;
+    options.lock_free = (mode == 1U) ? -1 : 0;
+    options.work_stealing = (mode == 2U) ? -1 : 0;
+    options.eager = -1;
+
+    return ctp_init_ex(&options);
+}
+
+static void print_row(const char* scenario, unsigned int mode,
+                      unsigned int producers, unsigned int threads,
+                      unsigned int tasks, const char* metric, double value,
+                      const char* unit)
+{
+    printf("%s,%s,%u,%u,%u,%s,%.3f,%s\n", scenario, mode_names[mode],
+           producers, threads, tasks, metric, value, unit);
+}
+
+static void bench_throughput(unsigned int mode)
+{
+    const unsigned int tasks = 100000U * scale;
+    pthread_t ids[4];
+    struct producer_t producers[4];
+    unsigned int p, t, r, i;
+
+    for (t = 0U; t < COUNTS_NUM; t++) {
+        for (p = 0U; p < COUNTS_NUM; p++) {
+            const unsigned int threads = counts[t];
+            const unsigned int np = counts[p];
+            unsigned long long best = 0U;
+
+            for (r = 0U; r < runs; r++) {
+                ctpool_t pool = make_pool(mode, threads, 0U, -1, 0);
+
+                if (pool != NULL) {
+                    const unsigned long long start = now_ns();
+                    unsigned long long elapsed;
+
+                    for (i = 0U; i < np; i++) {
+                        producers[i].pool = pool;
+                        producers[i].count = tasks / np;
+                        pthread_create(&ids[i], NULL, produce, &producers[i]);
+                    }
+                    for (i = 0U; i < np; i++) {
+                        pthread_join(ids[i], NULL);
+                    }
+                    ctp_wait_idle(pool, CTP_INFINITE);
+                    elapsed = now_ns() - start;
+                    ctp_finish(pool, NULL);
+
+                    if ((best == 0U) || (elapsed < best)) {
+                        best = elapsed;
+                    }
+                }
+            }
+
+            if (best > 0U) {
+                print_row("throughput", mode, np, threads, tasks,
+                          "tasks_per_s",
+                          ((double)tasks * 1e9) / (double)best, "1/s");
+            }
+        }
+    }
+}
+
+static void print_latency(const char* scenario, unsigned int mode,
+                          unsigned int threads, unsigned long long* lat,
+                          unsigned int n)
+{
+    static const unsigned int pcts[3] = { 50U, 90U, 99U };
+    static const char* const names[3] = { "p50", "p90", "p99" };
+    unsigned int i;
+
+    qsort(lat, n, sizeof(unsigned long long), compare_ull);
+
+    for (i = 0U; i < 3U; i++) {
+        const unsigned int k = (unsigned int)(((unsigned long long)(n - 1U)
+                                               * pcts[i]) / 100U);
+        print_row(scenario, mode, 1U, threads, n, names[i],
+                  (double)lat[k] / 1000.0, "us");
+    }
+    print_row(scenario, mode, 1U, threads, n, "max",
+              (double)lat[n - 1U] / 1000.0, "us");
+}
+
+static void bench_latency(unsigned int mode)
+{
+    const unsigned int n = 1000U * scale;
+    struct sample_t* const samples =
+        (struct sample_t*)malloc(sizeof(struct sample_t) * n);
+    unsigned long long* const lat =
+        (unsigned long long*)malloc(sizeof(unsigned long long) * n * runs);
+    unsigned int t, r, i, burst;
+
+    if ((samples != NULL) && (lat != NULL)) {
+        for (burst = 0U; burst < 2U; burst++) {
+            for (t = 0U; t < COUNTS_NUM; t++) {
+                unsigned int taken = 0U;
+
+                for (r = 0U; r < runs; r++) {
+                    ctpool_t pool = make_pool(mode, counts[t], n, -1, 0);
+
+                    if (pool != NULL) {
+                        atomic_store(&stamped, 0U);
+                        for (i = 0U; i < n; i++) {
+                            samples[i].submit = now_ns();
+                            ctp_add_work(pool, stamp, &samples[i]);
+                            if (burst == 0U) {
+                                wait_stamped(i + 1U);
+                            }
+                        }
+                        wait_stamped(n);
+                        ctp_finish(pool, NULL);
+
+                        for (i = 0U; i < n; i++) {
+                            lat[taken] = samples[i].start - samples[i].submit;
+                            taken++;
+                        }
+                    }
+                }
+
+                if (taken > 0U) {
+                    print_latency((burst == 0U) ? "latency_idle"
+                                                : "latency_burst",
+                                  mode, counts[t], lat, taken);
+                }
+            }
+        }
+    }
+
+    free(lat);
+    free(samples);
+}
+
+static void bench_overload(unsigned int mode)
+{
+    static const char* const scenarios[3] = {
+        "overload_discard", "overload_block", "overload_caller"
+    };
+    const unsigned int tasks = 20000U * scale;
+    unsigned int r, i, policy;
+
+    for (policy = 0U; policy < 3U; policy++) {
+        unsigned long long best = 0U;
+        unsigned int rejected = 0U;
+
+        for (r = 0U; r < runs; r++) {
+            ctpool_t pool = make_pool(mode, 1U, 64U, (policy == 1U) ? -1 : 0,
+                                      (policy == 2U) ? -1 : 0);
+
+            if (pool != NULL) {
+                const unsigned long long start = now_ns();
+                unsigned long long elapsed;
+                unsigned int failed = 0U;
+
+                for (i = 0U; i < tasks; i++) {
+                    if (ctp_add_work(pool, overload_work, NULL) == 0) {
+                        failed++;
+                    }
+                }
+                ctp_wait_idle(pool, CTP_INFINITE);
+                elapsed = now_ns() - start;
+                ctp_finish(pool, NULL);
+
+                if ((best == 0U) || (elapsed < best)) {
+                    best = elapsed;
+                    rejected = failed;
+                }
+            }
+        }
+
+        if (best > 0U) {
+            const char* const scenario = scenarios[policy];
+            print_row(scenario, mode, 1U, 1U, tasks, "elapsed",
+                      (double)best / 1e6, "ms");
+            print_row(scenario, mode, 1U, 1U, tasks, "rejected",
+                      ((double)rejected * 100.0) / (double)tasks, "%");
+        }
+    }
+}
+
+static void bench_pause(unsigned int mode)
+{
+    const unsigned int pairs = 10000U * scale;
+    const unsigned int tasks = 1000U * scale;
+    unsigned long long best_pair = 0U;
+    unsigned long long best_drain = 0U;
+    unsigned int r, i;
+
+    for (r = 0U; r < runs; r++) {
+        ctpool_t pool = make_pool(mode, 4U, tasks, -1, 0);
+
+        if (pool != NULL) {
+            unsigned long long start = now_ns();
+            unsigned long long elapsed;
+
+            for (i = 0U; i < pairs; i++) {
+                ctp_pause(pool);
+                ctp_resume(pool);
+            }
+            elapsed = now_ns() - start;
+            if ((best_pair == 0U) || (elapsed < best_pair)) {
+                best_pair = elapsed;
+            }
+
+            ctp_pause(pool);
+            for (i = 0U; i < tasks; i++) {
+                ctp_add_work(pool, empty, NULL);
+            }
+            start = now_ns();
+            ctp_resume(pool);
+            ctp_wait_idle(pool, CTP_INFINITE);
+            elapsed = now_ns() - start;
+            if ((best_drain == 0U) || (elapsed < best_drain)) {
+                best_drain = elapsed;
+            }
+
+            ctp_finish(pool, NULL);
+        }
+    }
+
+    if (best_pair > 0U) {
+        print_row("pause_resume", mode, 1U, 4U, pairs, "pair",
+                  (double)best_pair / (double)pairs, "ns");
+        print_row("pause_resume", mode, 1U, 4U, tasks, "drain",
+                  (double)best_drain / 1e6, "ms");
+    }
+}
+
+static void bench_mixed(unsigned int mode)
+{
+    const unsigned int tasks = 2000U * scale;
+    unsigned int t, r, i;
+
+    for (t = 0U; t < COUNTS_NUM; t++) {
+        unsigned long long best = 0U;
+
+        for (r = 0U; r < runs; r++) {
+            ctpool_t pool = make_pool(mode, counts[t], 0U, -1, 0);
+
+            if (pool != NULL) {
+                const unsigned long long start = now_ns();
+                unsigned long long elapsed;
+
+                for (i = 0U; i < tasks; i++) {
+                    ctp_add_work(pool, ((i % 10U) == 0U) ? long_work
+                                                         : short_work, NULL);
+                }
+                ctp_wait_idle(pool, CTP_INFINITE);
+                elapsed = now_ns() - start;
+                ctp_finish(pool, NULL);
+
+                if ((best == 0U) || (elapsed < best)) {
+                    best = elapsed;
+                }
+            }
+        }
+
+        if (best > 0U) {
+            print_row("mixed", mode, 1U, counts[t], tasks, "makespan",
+                      (double)best / 1e6, "ms");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int mode;
+
+    if (argc > 1) {
+        scale = (unsigned int)strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        runs = (unsigned int)strtoul(argv[2], NULL, 10);
+    }
+    if (scale == 0U) {
+        scale = 1U;
+    }
+    if (runs == 0U) {
+        runs = 1U;
+    }
+
+    puts("scenario,mode,producers,threads,tasks,metric,value,unit");
+
+    for (mode = 0U; mode < MODES_NUM; mode++) {
+        bench_throughput(mode);
+        bench_latency(mode);
+        bench_overload(mode);
+        bench_pause(mode);
+        bench_mixed(mode);
+    }
+
+    return 0;
+}
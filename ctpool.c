@@ -1,445 +1,4842 @@
-#include "ctpool.h"
-#include <stdlib.h>
-#include <pthread.h>
-#include <semaphore.h>
-
-#ifdef _WIN32
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#elif (defined(__linux__)) || (defined(_AIX)) || (defined(__sun))
-#include <unistd.h>
-#define CTP_ON_LINUX
-#elif (defined(__FreeBSD__)) || (defined(__NetBSD__)) \
-      || (defined(__OpenBSD__)) || (defined(__bsdi__)) \
-      || (defined(__DragonFly__)) \
-      || ((defined(__APPLE__)) && (defined(__MACH__)))
-#define CTP_ON_BSD
-#include <sys/sysctl.h>
-#include <sys/types.h>
-#else
-#endif
-
-#ifndef CTP_DEFAULT_THREADS_NUM
-#define CTP_DEFAULT_THREADS_NUM 4U
-#else
-#if (CTP_DEFAULT_THREADS_NUM < 1)
-#error Invalid CTP_DEFAULT_THREADS_NUM value
-#endif
-#endif
-
-#ifndef CTP_MULTIPLY_QUEUE_FACTOR
-#define CTP_MULTIPLY_QUEUE_FACTOR 8U
-#else
-#if (CTP_MULTIPLY_QUEUE_FACTOR < 1)
-#error Invalid CTP_MULTIPLY_QUEUE_FACTOR value
-#endif
-#endif
-
-#ifndef CTP_MIN_QUEUE_SIZE
-#define CTP_MIN_QUEUE_SIZE 256U
-#else
-#if (CTP_MIN_QUEUE_SIZE < 1)
-#error Invalid CTP_MIN_QUEUE_SIZE value
-#endif
-#endif
-
-#define NON_PAUSED_VALUE (0U - 1U)
-
-
-typedef unsigned int pu;
-
-struct worker_t {
-    pool_worker_t func;
-    void* argument;
-};
-
-struct pool_t {
-    struct worker_t* queue;
-    pthread_t* threads;
-    pthread_mutex_t mutex;
-    sem_t semaphore;
-    sem_t sem_add;
-    pu threads_num;
-    pu running;
-    pu waiting;
-    pu queue_size;
-    pu queue_count;
-    pu old_count;
-    pu head;
-    int block;
-    int done;
-};
-
-
-static pu get_threads_num(void)
-{
-    pu cpus = CTP_DEFAULT_THREADS_NUM;
-
-#ifdef _WIN32
-    SYSTEM_INFO si;
-    GetSystemInfo(&si);
-    if (si.dwNumberOfProcessors > 0U) {
-        cpus = (pu)si.dwNumberOfProcessors;
-    }
-#elif defined CTP_ON_LINUX
-
-#if defined _SC_NPROCESSORS_ONLN
-    const long v = sysconf(_SC_NPROCESSORS_ONLN);
-    if (v > 0) {
-        cpus = (pu)v;
-    }
-#endif
-
-#elif defined CTP_ON_BSD
-    int mib[2];
-    size_t len = sizeof(int);
-    int v;
-
-    mib[0] = CTL_HW;
-    mib[1] = HW_NCPU;
-    if ((sysctl(mib, 2U, &v, &len, NULL, 0U) == 0)
-        && (v > 0))
-    {
-        cpus = (pu)v;
-    }
-#endif
-
-    return cpus;
-}
-
-static void* run(void* arg)
-{
-    struct pool_t* const p = (struct pool_t*)arg;
-    int must_sleep = 0;
-
-    for (;;) {
-        pthread_mutex_lock(&p->mutex);
-
-        if (must_sleep != 0) {
-            p->waiting--;
-        }
-
-        must_sleep = (p->queue_count == 0U);
-
-        if (must_sleep == 0) {
-            pool_worker_t func = p->queue[p->head].func;
-            void* const argument = p->queue[p->head].argument;
-
-            if (++p->head == p->queue_size) {
-                p->head = 0U;
-            }
-            if (--p->queue_count == 0U) {
-                p->head = 0U;
-            }
-
-            sem_post(&p->sem_add);
-            pthread_mutex_unlock(&p->mutex);
-
-            func(argument);
-        }
-        else {
-            if (p->done == 0) {
-                p->waiting++;
-                pthread_mutex_unlock(&p->mutex);
-                sem_wait(&p->semaphore);
-            }
-            else {
-                break;
-            }
-        }
-    }
-
-    p->running--;
-
-    pthread_mutex_unlock(&p->mutex);
-
-    pthread_exit(NULL);
-    return NULL;
-}
-
-static struct pool_t* free_resources(struct pool_t* p, int level)
-{
-    if ((level > 0) && (level < 6)) {
-        if (level >= 2) {
-            free(p->threads);
-        }
-        if (level >= 3) {
-            free(p->queue);
-        }
-        if (level >= 4) {
-            pthread_mutex_destroy(&p->mutex);
-        }
-        if (level >= 5) {
-            sem_destroy(&p->semaphore);
-        }
-
-        free(p);
-        p = NULL;
-    }
-
-    return p;
-}
-
-ctpool_t ctp_init(unsigned int threads_num, unsigned int queue_size, int block)
-{
-    int level = 0;
-
-    struct pool_t* p = (struct pool_t*)malloc(sizeof(struct pool_t));
-    if (p != NULL) {
-        level++;
-
-        p->threads_num = (threads_num > 0U) ? threads_num : get_threads_num();
-        p->threads = (pthread_t*)malloc(sizeof(pthread_t)
-                                        * (size_t)p->threads_num);
-        if (p->threads != NULL) {
-            level++;
-
-            if (queue_size > 0U) {
-                p->queue_size = queue_size;
-            }
-            else {
-                p->queue_size = p->threads_num * CTP_MULTIPLY_QUEUE_FACTOR;
-                if (p->queue_size < CTP_MIN_QUEUE_SIZE) {
-                    p->queue_size = CTP_MIN_QUEUE_SIZE;
-                }
-            }
-            if (p->queue_size == NON_PAUSED_VALUE) {
-                p->queue_size--;
-            }
-
-            p->queue = (struct worker_t*) malloc(sizeof(struct worker_t)
-                                                 * (size_t)(p->queue_size));
-            if (p->queue != NULL) {
-                level++;
-
-                if (pthread_mutex_init(&p->mutex, NULL) == 0) {
-                    level++;
-
-                    if (sem_init(&p->semaphore, 0, 0U) == 0) {
-                        level++;
-
-                        if (sem_init(&p->sem_add, 0, p->queue_size) == 0) {
-                            level++;
-
-                            p->running = 0U;
-                            p->waiting = 0U;
-                            p->queue_count = 0U;
-                            p->old_count = NON_PAUSED_VALUE;
-                            p->head = 0U;
-                            p->block = block;
-                            p->done = 0;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    p = free_resources(p, level);
-
-    return p;
-}
-
-static int add_last(struct pool_t* p, pu* p_count)
-{
-    const int ok = (p->block != 0) && (p->old_count == NON_PAUSED_VALUE);
-
-    if (ok != 0) {
-        int owned = 0;
-
-        do {
-            pthread_mutex_unlock(&p->mutex);
-
-            sem_wait(&p->sem_add);
-
-            pthread_mutex_lock(&p->mutex);
-
-            if (*p_count == p->queue_size) {
-                sem_post(&p->sem_add);
-            }
-            else {
-                owned--;
-            }
-
-        } while (owned == 0);
-    }
-
-    return ok;
-}
-
-int ctp_add_work(ctpool_t pool, pool_worker_t func, void* argument)
-{
-    struct pool_t* const p = (struct pool_t*)pool;
-    int added = -1;
-
-    pthread_mutex_lock(&p->mutex);
-
-    if (p->done == 0) {
-        pu* const p_count = (p->old_count == NON_PAUSED_VALUE) ?
-            &p->queue_count : &p->old_count;
-
-        if (*p_count == p->queue_size) {
-            added = add_last(p, p_count);
-        }
-        else {
-            sem_wait(&p->sem_add);
-        }
-
-        if (added != 0) {
-            pu index = p->head + *p_count;
-            if (index >= p->queue_size) {
-                index -= p->queue_size;
-            }
-            p->queue[index].func = func;
-            p->queue[index].argument = argument;
-            *p_count = *p_count + 1U;
-
-            if (p->waiting > 0U) {
-                sem_post(&p->semaphore);
-            }
-            else {
-                if (p->running < p->threads_num) {
-                    added = pthread_create(&p->threads[p->running],
-                                           NULL, run, p);
-                    if ((added == 0) || (p->running > 0U)) {
-                        if (added == 0) {
-                            p->running++;
-                        }
-                        added = -1;
-                    }
-                    else {
-                        *p_count = *p_count - 1U;
-                        added = 0;
-                    }
-                }
-            }
-        }
-    }
-
-    pthread_mutex_unlock(&p->mutex);
-
-    return added;
-}
-
-void ctp_pause(ctpool_t pool)
-{
-    struct pool_t* const p = (struct pool_t*)pool;
-    pthread_mutex_lock(&p->mutex);
-    if (p->old_count == NON_PAUSED_VALUE) {
-        p->old_count = p->queue_count;
-        p->queue_count = 0U;
-    }
-    pthread_mutex_unlock(&p->mutex);
-}
-
-void ctp_resume(ctpool_t pool)
-{
-    struct pool_t* const p = (struct pool_t*)pool;
-    pthread_mutex_lock(&p->mutex);
-    if (p->old_count != NON_PAUSED_VALUE) {
-        pu i;
-
-        p->queue_count = p->old_count;
-        p->old_count = NON_PAUSED_VALUE;
-
-        for (i = 0U; i < p->waiting; i++) {
-            sem_post(&p->semaphore);
-        }
-    }
-    pthread_mutex_unlock(&p->mutex);
-}
-
-void ctp_clear_queue(ctpool_t pool)
-{
-    struct pool_t* const p = (struct pool_t*)pool;
-    pthread_mutex_lock(&p->mutex);
-    if (p->old_count != NON_PAUSED_VALUE) {
-        p->old_count = 0U;
-    }
-    else {
-        p->queue_count = 0U;
-    }
-    p->head = 0U;
-    pthread_mutex_unlock(&p->mutex);
-}
-
-void ctp_finish(ctpool_t pool, unsigned int* spawned)
-{
-    struct pool_t* const p = (struct pool_t*)pool;
-
-    pthread_mutex_lock(&p->mutex);
-
-    if (p->done == 0) {
-        const pu running = p->running;
-        pu i;
-
-        p->done--;
-
-        if (p->old_count != NON_PAUSED_VALUE) {
-            p->queue_count = p->old_count;
-            p->old_count = NON_PAUSED_VALUE;
-        }
-
-        for (i = 0U; i < p->waiting; i++) {
-            sem_post(&p->semaphore);
-        }
-
-        if (spawned != NULL) {
-            *spawned = running;
-        }
-
-        pthread_mutex_unlock(&p->mutex);
-
-        for (i = 0U; i < running; i++) {
-            pthread_join(p->threads[i], NULL);
-        }
-
-        sem_destroy(&p->sem_add);
-        sem_destroy(&p->semaphore);
-        free(p->queue);
-        free(p->threads);
-        pthread_mutex_destroy(&p->mutex);
-        free(p);
-    }
-    else {
-        pthread_mutex_unlock(&p->mutex);
-    }
-}
-
-int ctp_get_status(const ctpool_t pool)
-{
-    const struct pool_t* const p = (const struct pool_t*)pool;
-    int status = (p->old_count == NON_PAUSED_VALUE) ? 1 : -1;
-    if ((status == 1) && (p->waiting == p->running)) {
-        status = 0;
-    }
-    return status;
-}
-
-unsigned int ctp_get_threads_num(const ctpool_t pool)
-{
-    const struct pool_t* const p = (const struct pool_t*)pool;
-    return p->threads_num;
-}
-
-unsigned int ctp_get_works_count(const ctpool_t pool)
-{
-    const struct pool_t* const p = (const struct pool_t*)pool;
-    return (p->old_count == NON_PAUSED_VALUE) ? p->queue_count : p->old_count;
-}
-
-unsigned int ctp_get_queue_size(const ctpool_t pool)
-{
-    const struct pool_t* const p = (const struct pool_t*)pool;
-    return p->queue_size;
-}
-
-unsigned int ctp_get_load_factor(const ctpool_t pool)
-{
-    const struct pool_t* const p = (const struct pool_t*)pool;
-    const pu count = (p->old_count == NON_PAUSED_VALUE) ?
-        p->queue_count : p->old_count;
-    const float sum = (float)(p->running + count);
-    const float k = ((sum * 100.0f) / (float)p->threads_num) + 0.5f;
-    return (unsigned int)k;
-}
+#if (defined(__linux__)) && (!defined(_GNU_SOURCE))
+#define _GNU_SOURCE
+#endif
+
+#include "ctpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#elif (defined(__linux__)) || (defined(_AIX)) || (defined(__sun))
+#include <unistd.h>
+#define CTP_ON_LINUX
+#elif (defined(__FreeBSD__)) || (defined(__NetBSD__)) \
+      || (defined(__OpenBSD__)) || (defined(__bsdi__)) \
+      || (defined(__DragonFly__)) \
+      || ((defined(__APPLE__)) && (defined(__MACH__)))
+#define CTP_ON_BSD
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#else
+#endif
+
+#ifdef __linux__
+#define CTP_HAS_AFFINITY
+#define CTP_HAS_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#ifndef _WIN32
+#define CTP_HAS_NOTIFY_FD
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifndef CTP_DEFAULT_THREADS_NUM
+#define CTP_DEFAULT_THREADS_NUM 4U
+#else
+#if (CTP_DEFAULT_THREADS_NUM < 1)
+#error Invalid CTP_DEFAULT_THREADS_NUM value
+#endif
+#endif
+
+#ifndef CTP_MULTIPLY_QUEUE_FACTOR
+#define CTP_MULTIPLY_QUEUE_FACTOR 8U
+#else
+#if (CTP_MULTIPLY_QUEUE_FACTOR < 1)
+#error Invalid CTP_MULTIPLY_QUEUE_FACTOR value
+#endif
+#endif
+
+#ifndef CTP_MIN_QUEUE_SIZE
+#define CTP_MIN_QUEUE_SIZE 256U
+#else
+#if (CTP_MIN_QUEUE_SIZE < 1)
+#error Invalid CTP_MIN_QUEUE_SIZE value
+#endif
+#endif
+
+#ifndef CTP_CACHE_LINE
+#define CTP_CACHE_LINE 64U
+#else
+#if (CTP_CACHE_LINE < 16)
+#error Invalid CTP_CACHE_LINE value
+#endif
+#endif
+
+#ifndef CTP_DEQUE_SIZE
+#define CTP_DEQUE_SIZE 1024U
+#else
+#if (CTP_DEQUE_SIZE < 2) || ((CTP_DEQUE_SIZE & (CTP_DEQUE_SIZE - 1)) != 0)
+#error Invalid CTP_DEQUE_SIZE value
+#endif
+#endif
+
+#ifndef CTP_MAX_DEQUEUE_BATCH
+#define CTP_MAX_DEQUEUE_BATCH 64U
+#else
+#if (CTP_MAX_DEQUEUE_BATCH < 1)
+#error Invalid CTP_MAX_DEQUEUE_BATCH value
+#endif
+#endif
+
+#ifndef CTP_SLAB_CHUNK
+#define CTP_SLAB_CHUNK 64U
+#else
+#if (CTP_SLAB_CHUNK < 1)
+#error Invalid CTP_SLAB_CHUNK value
+#endif
+#endif
+
+#ifndef CTP_PRIO_AGING
+#define CTP_PRIO_AGING 16U
+#else
+#if (CTP_PRIO_AGING < 1)
+#error Invalid CTP_PRIO_AGING value
+#endif
+#endif
+
+#ifndef CTP_SEGMENT_SIZE
+#define CTP_SEGMENT_SIZE 256U
+#else
+#if (CTP_SEGMENT_SIZE < 1)
+#error Invalid CTP_SEGMENT_SIZE value
+#endif
+#endif
+
+#ifndef CTP_SEGMENT_CACHE
+#define CTP_SEGMENT_CACHE 16U
+#endif
+
+#ifndef CTP_BLOCKING_KEEP_ALIVE
+#define CTP_BLOCKING_KEEP_ALIVE 1000U
+#endif
+
+#ifndef CTP_INLINE_PAYLOAD
+#define CTP_INLINE_PAYLOAD 32U
+#else
+#if (CTP_INLINE_PAYLOAD < 0)
+#error Invalid CTP_INLINE_PAYLOAD value
+#endif
+#endif
+
+#define NON_PAUSED_VALUE (0U - 1U)
+#define POOL_READY 12
+
+#define SLOT_FREE 0
+#define SLOT_LIVE 1
+#define SLOT_RETIRED 2
+#define SLOT_STARTING 3
+
+#define FUTURE_DONE 1
+#define FUTURE_RELEASED 2
+#define FUTURE_WAITED 4
+
+#define PARK_WOKEN 0
+#define PARK_EXPIRED 1
+#define PARK_TIMER 2
+
+#define WHEEL_BITS 6U
+#define WHEEL_SLOTS 64U
+#define WHEEL_LEVELS 4U
+#define TIMER_READY (WHEEL_LEVELS * WHEEL_SLOTS)
+#define TIMER_NONE (0U - 1U)
+#define TIMER_NEVER (0ULL - 1ULL)
+
+#define PAYLOAD_NONE 0U
+#define PAYLOAD_INLINE 1U
+#define PAYLOAD_SLAB 2U
+#define PAYLOAD_MIN 64U
+#define PAYLOAD_CLASSES 5U
+
+#define STRAND_BATCH 32U
+
+#define HELPER_PARK_MS 10U
+
+
+typedef unsigned int pu;
+
+#if (CTP_INLINE_PAYLOAD > 0)
+union inline_t {
+    unsigned char bytes[CTP_INLINE_PAYLOAD];
+    max_align_t align;
+};
+#endif
+
+struct worker_t {
+    union {
+        pool_worker_t func;
+        ctp_worker_ex_t func_ex;
+    };
+    void* argument;
+    const void* tag;
+    pu payload;
+    int ex;
+#ifdef CTP_STATS
+    unsigned long long stamp;
+#endif
+#if (CTP_INLINE_PAYLOAD > 0)
+    union inline_t data;
+#endif
+};
+
+#ifdef CTP_STATS
+struct stats_t {
+    atomic_ullong submitted;
+    atomic_ullong rejected;
+    atomic_ullong blocked;
+    atomic_ullong block_ns;
+    atomic_ullong completed;
+    atomic_ullong idle_ns;
+    atomic_ullong busy_ns;
+    atomic_ullong wait[CTP_HISTOGRAM_BUCKETS];
+    atomic_ullong run[CTP_HISTOGRAM_BUCKETS];
+    char pad[CTP_CACHE_LINE];
+};
+#endif
+
+struct timer_node_t {
+    unsigned long long due;
+    pool_worker_t func;
+    void* argument;
+    pu period;
+    pu generation;
+    pu list;
+    pu prev;
+    pu next;
+};
+
+struct cell_t {
+    atomic_size_t seq;
+    struct worker_t work;
+};
+
+struct lf_queue_t {
+    struct cell_t* cells;
+    size_t mask;
+    char pad0[CTP_CACHE_LINE];
+    atomic_size_t enqueue_pos;
+    char pad1[CTP_CACHE_LINE - sizeof(atomic_size_t)];
+    atomic_size_t dequeue_pos;
+    char pad2[CTP_CACHE_LINE - sizeof(atomic_size_t)];
+};
+
+union slab_header {
+    void* next;
+    max_align_t align;
+};
+
+struct slab_t {
+    pthread_mutex_t mutex;
+    void* free_list;
+    union slab_header* chunks;
+    size_t size;
+};
+
+struct deque_t {
+    atomic_size_t top;
+    char pad0[CTP_CACHE_LINE - sizeof(atomic_size_t)];
+    atomic_size_t bottom;
+    struct worker_t* buffer;
+    char pad1[CTP_CACHE_LINE];
+};
+
+struct local_t {
+    struct deque_t deque;
+    struct pool_t* pool;
+    pu index;
+    pu seed;
+    pu spin_budget;
+    atomic_int state;
+    void* context;
+    struct local_t* next;
+#ifdef CTP_STATS
+    struct stats_t stats;
+#endif
+};
+
+struct segment_t {
+    struct segment_t* next;
+    struct worker_t works[CTP_SEGMENT_SIZE];
+};
+
+struct lane_t {
+    struct worker_t* queue;
+    struct segment_t* first;
+    struct segment_t* last;
+    pu tail;
+    sem_t sem_add;
+    pu size;
+    pu count;
+    pu head;
+    _Atomic pu blocked;
+    struct lf_queue_t lfq;
+};
+
+#ifdef CTP_HAS_AFFINITY
+struct topology_t {
+    pu cpus[CPU_SETSIZE];
+    pu nodes[CPU_SETSIZE];
+    pu first[CPU_SETSIZE + 1];
+    pu nodes_num;
+};
+#endif
+
+struct pool_t {
+    struct lane_t* lanes;
+    pthread_t* threads;
+    struct local_t** locals;
+#ifdef CTP_HAS_AFFINITY
+    cpu_set_t* cpusets;
+#endif
+    pthread_mutex_t mutex;
+    sem_t semaphore;
+    pu threads_num;
+    pu min_threads;
+    pu keep_alive_ms;
+    _Atomic pu slots;
+    _Atomic pu spawning;
+    pu lanes_num;
+    pu lanes_ready;
+    _Atomic pu running;
+    _Atomic pu waiting;
+    pu queue_size;
+    pu dequeue_batch;
+    pu spin_count;
+    pu yield_count;
+    pu queue_count;
+    pu old_count;
+    _Atomic pu prio_tick;
+    int block;
+    int caller_runs;
+    ctp_thread_start_t thread_start;
+    ctp_thread_exit_t thread_exit;
+    void* hook_argument;
+    pu high_watermark;
+    pu low_watermark;
+    ctp_watermark_t watermark;
+    void* watermark_argument;
+    atomic_int above;
+    atomic_int done;
+    int lock_free;
+    atomic_int paused;
+    _Atomic pu pending;
+    _Atomic pu idle_waiters;
+    _Atomic pu wakeups_avoided;
+    int work_stealing;
+    int affinity;
+    int unbounded;
+    struct segment_t* free_segments;
+    pu free_count;
+    pu segments;
+    pu max_segments;
+    pu space_waiters;
+    pthread_cond_t space_cond;
+    struct slab_t futures;
+    struct slab_t payloads[PAYLOAD_CLASSES];
+    struct slab_t completions;
+    _Atomic(struct completion_t*) completion_tail;
+    struct completion_t* completion_head;
+    atomic_int completion_armed;
+    int notify;
+    int notify_fd[2];
+    ctpool_t io;
+    _Atomic pu blocking;
+    _Atomic pu helpers;
+    pthread_mutex_t timer_mutex;
+    struct timer_node_t* timers;
+    pu timers_size;
+    pu timer_free;
+    _Atomic pu timers_num;
+    pu wheel_count;
+    unsigned long long wheel_now;
+    unsigned long long timer_sleep;
+    atomic_ullong timer_next;
+    unsigned long long wheel_bits[WHEEL_LEVELS];
+    pu timer_heads[TIMER_READY + 1U];
+#ifdef CTP_STATS
+    struct stats_t stats;
+#endif
+    pthread_mutex_t signal_mutex;
+    pthread_cond_t signal_cond;
+};
+
+struct range_t {
+    _Atomic size_t next;
+    _Atomic size_t completed;
+    _Atomic pu slots;
+    _Atomic pu refs;
+    size_t end;
+    size_t total;
+    size_t grain;
+    pu parts;
+    ctp_range_worker_t func;
+    ctp_reduce_worker_t reduce;
+    ctp_combine_t combine;
+    void* context;
+    char* accumulators;
+    size_t stride;
+    sem_t done;
+};
+
+struct graph_node_t {
+    struct ctp_graph* graph;
+    pool_worker_t func;
+    void* argument;
+    pu* next;
+    pu next_num;
+    pu next_size;
+    pu preds;
+    _Atomic pu waiting;
+    struct graph_node_t* link;
+};
+
+struct ctp_graph {
+    struct graph_node_t* nodes;
+    pu nodes_num;
+    pu nodes_size;
+    int checked;
+    int running;
+    struct pool_t* pool;
+    _Atomic pu left;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+struct strand_node_t {
+    pool_worker_t func;
+    void* argument;
+    struct strand_node_t* next;
+};
+
+struct strand_lane_t {
+    pthread_mutex_t mutex;
+    struct ctp_strand* owner;
+    struct strand_node_t* head;
+    struct strand_node_t* tail;
+    struct strand_node_t* free_nodes;
+    int scheduled;
+    char pad[CTP_CACHE_LINE];
+};
+
+struct ctp_strand {
+    struct pool_t* pool;
+    struct strand_lane_t* lanes;
+    pu lanes_num;
+    _Atomic pu busy;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+struct completion_t {
+    _Atomic(struct completion_t*) next;
+    struct pool_t* pool;
+    pool_worker_t func;
+    void* argument;
+    void* result;
+};
+
+struct ctp_future {
+    struct pool_t* pool;
+    pool_worker_t func;
+    void* argument;
+    void* result;
+    atomic_int state;
+};
+
+static pthread_key_t local_key;
+static const char range_tag = 0;
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+static int local_key_error = -1;
+
+
+static pu get_threads_num(void)
+{
+    pu cpus = CTP_DEFAULT_THREADS_NUM;
+
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors > 0U) {
+        cpus = (pu)si.dwNumberOfProcessors;
+    }
+#elif defined CTP_ON_LINUX
+
+#if defined _SC_NPROCESSORS_ONLN
+    const long v = sysconf(_SC_NPROCESSORS_ONLN);
+    if (v > 0) {
+        cpus = (pu)v;
+    }
+#endif
+
+#elif defined CTP_ON_BSD
+    int mib[2];
+    size_t len = sizeof(int);
+    int v;
+
+    mib[0] = CTL_HW;
+    mib[1] = HW_NCPU;
+    if ((sysctl(mib, 2U, &v, &len, NULL, 0U) == 0)
+        && (v > 0))
+    {
+        cpus = (pu)v;
+    }
+#endif
+
+    return cpus;
+}
+
+#ifdef CTP_HAS_AFFINITY
+static pu read_cpulist(const char* path, pu* items, pu max)
+{
+    FILE* const f = fopen(path, "r");
+    pu n = 0U;
+
+    if (f != NULL) {
+        unsigned int first, last;
+        int c = ',';
+
+        while ((c == ',') && (fscanf(f, "%u", &first) == 1)) {
+            last = first;
+            c = fgetc(f);
+            if ((c == '-') && (fscanf(f, "%u", &last) == 1)) {
+                c = fgetc(f);
+            }
+            while ((first <= last) && (first < CPU_SETSIZE) && (n < max)) {
+                items[n] = first;
+                n++;
+                first++;
+            }
+        }
+
+        fclose(f);
+    }
+
+    return n;
+}
+
+static void read_topology(struct topology_t* t)
+{
+    const pu nodes = read_cpulist("/sys/devices/system/node/online",
+                                  t->nodes, CPU_SETSIZE);
+    pu count = 0U;
+    pu i;
+
+    t->nodes_num = 0U;
+    for (i = 0U; i < nodes; i++) {
+        char path[64];
+        pu n;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+                 t->nodes[i]);
+        n = read_cpulist(path, &t->cpus[count], CPU_SETSIZE - count);
+        if (n > 0U) {
+            t->nodes[t->nodes_num] = t->nodes[i];
+            t->first[t->nodes_num] = count;
+            t->nodes_num++;
+            count += n;
+        }
+    }
+
+    if (t->nodes_num == 0U) {
+        count = read_cpulist("/sys/devices/system/cpu/online", t->cpus,
+                             CPU_SETSIZE);
+        if (count == 0U) {
+            count = get_threads_num();
+            if (count > CPU_SETSIZE) {
+                count = CPU_SETSIZE;
+            }
+            for (i = 0U; i < count; i++) {
+                t->cpus[i] = i;
+            }
+        }
+        t->nodes[0] = 0U;
+        t->first[0] = 0U;
+        t->nodes_num = 1U;
+    }
+
+    t->first[t->nodes_num] = count;
+}
+
+static int fill_cpusets(struct pool_t* p, const ctp_options_t* options,
+                        const struct topology_t* t)
+{
+    const pu cpus_num = t->first[t->nodes_num];
+    pu node = 0U;
+    pu i;
+    int error = 0;
+
+    if (options->affinity == CTP_AFFINITY_NODE) {
+        while ((node < t->nodes_num) && (t->nodes[node] != options->numa_node)) {
+            node++;
+        }
+        error = (node == t->nodes_num) ? -1 : 0;
+    }
+
+    if ((p->threads_num == 0U) && (error == 0)) {
+        p->threads_num = (options->affinity == CTP_AFFINITY_NODE) ?
+                         (t->first[node + 1U] - t->first[node]) : cpus_num;
+    }
+
+    if (options->affinity == CTP_AFFINITY_CPUSET) {
+        for (i = 0U; (error == 0) && (i < options->cpus_num); i++) {
+            error = (options->cpus[i] < CPU_SETSIZE) ? 0 : -1;
+        }
+    }
+
+    if (error == 0) {
+        p->cpusets = (cpu_set_t*)malloc(sizeof(cpu_set_t)
+                                        * (size_t)p->threads_num);
+        error = (p->cpusets != NULL) ? 0 : -1;
+    }
+
+    for (i = 0U; (error == 0) && (i < p->threads_num); i++) {
+        cpu_set_t* const set = &p->cpusets[i];
+
+        CPU_ZERO(set);
+        if (options->affinity == CTP_AFFINITY_COMPACT) {
+            CPU_SET(t->cpus[i % cpus_num], set);
+        }
+        else if (options->affinity == CTP_AFFINITY_SCATTER) {
+            const pu n = i % t->nodes_num;
+            const pu size = t->first[n + 1U] - t->first[n];
+            CPU_SET(t->cpus[t->first[n] + ((i / t->nodes_num) % size)], set);
+        }
+        else if (options->affinity == CTP_AFFINITY_CPUSET) {
+            CPU_SET(options->cpus[i % options->cpus_num], set);
+        }
+        else {
+            pu k;
+            for (k = t->first[node]; k < t->first[node + 1U]; k++) {
+                CPU_SET(t->cpus[k], set);
+            }
+        }
+    }
+
+    return error;
+}
+#endif
+
+static int init_affinity(struct pool_t* p, const ctp_options_t* options)
+{
+    int error = 0;
+
+    p->threads_num = options->threads_num;
+    p->affinity = options->affinity;
+
+    if (options->affinity == CTP_AFFINITY_CPUSET) {
+        if ((options->cpus == NULL) || (options->cpus_num == 0U)) {
+            error = -1;
+        }
+        else if (p->threads_num == 0U) {
+            p->threads_num = options->cpus_num;
+        }
+    }
+
+#ifdef CTP_HAS_AFFINITY
+    p->cpusets = NULL;
+
+    if ((options->affinity != CTP_AFFINITY_NONE) && (error == 0)) {
+        struct topology_t* const t = (struct topology_t*)
+            malloc(sizeof(struct topology_t));
+
+        error = -1;
+        if (t != NULL) {
+            read_topology(t);
+            error = fill_cpusets(p, options, t);
+            free(t);
+        }
+    }
+#endif
+
+    if ((p->threads_num == 0U) && (error == 0)) {
+        p->threads_num = get_threads_num();
+    }
+
+    return error;
+}
+
+static void monotonic_now(struct timespec* ts)
+{
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, ts);
+#else
+    timespec_get(ts, TIME_UTC);
+#endif
+}
+
+static unsigned long long now_ms(void)
+{
+    struct timespec ts;
+    monotonic_now(&ts);
+    return ((unsigned long long)ts.tv_sec * 1000U)
+           + ((unsigned long long)ts.tv_nsec / 1000000U);
+}
+
+static void get_deadline_us(struct timespec* ts, unsigned long long timeout_us)
+{
+    timespec_get(ts, TIME_UTC);
+    ts->tv_sec += (time_t)(timeout_us / 1000000U);
+    ts->tv_nsec += (long)(timeout_us % 1000000U) * 1000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void get_deadline(struct timespec* ts, unsigned int timeout_ms)
+{
+    get_deadline_us(ts, (unsigned long long)timeout_ms * 1000U);
+}
+
+static unsigned long long stats_clock(void)
+{
+#ifdef CTP_STATS
+    struct timespec ts;
+    monotonic_now(&ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL)
+           + (unsigned long long)ts.tv_nsec;
+#else
+    return 0U;
+#endif
+}
+
+#ifdef CTP_STATS
+static void stats_init(struct stats_t* s)
+{
+    pu i;
+
+    atomic_init(&s->submitted, 0U);
+    atomic_init(&s->rejected, 0U);
+    atomic_init(&s->blocked, 0U);
+    atomic_init(&s->block_ns, 0U);
+    atomic_init(&s->completed, 0U);
+    atomic_init(&s->idle_ns, 0U);
+    atomic_init(&s->busy_ns, 0U);
+    for (i = 0U; i < CTP_HISTOGRAM_BUCKETS; i++) {
+        atomic_init(&s->wait[i], 0U);
+        atomic_init(&s->run[i], 0U);
+    }
+}
+
+static void stats_add(atomic_ullong* counter, unsigned long long value)
+{
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static pu stats_bucket(unsigned long long ns)
+{
+    pu bucket = 0U;
+
+    while ((ns > 1U) && (bucket < (CTP_HISTOGRAM_BUCKETS - 1U))) {
+        ns >>= 1U;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void stats_sum(ctp_stats_t* out, struct stats_t* s)
+{
+    pu i;
+
+    out->submitted += atomic_load_explicit(&s->submitted, memory_order_relaxed);
+    out->rejected += atomic_load_explicit(&s->rejected, memory_order_relaxed);
+    out->blocked += atomic_load_explicit(&s->blocked, memory_order_relaxed);
+    out->block_ns += atomic_load_explicit(&s->block_ns, memory_order_relaxed);
+    out->completed += atomic_load_explicit(&s->completed, memory_order_relaxed);
+    out->idle_ns += atomic_load_explicit(&s->idle_ns, memory_order_relaxed);
+    out->busy_ns += atomic_load_explicit(&s->busy_ns, memory_order_relaxed);
+    for (i = 0U; i < CTP_HISTOGRAM_BUCKETS; i++) {
+        out->wait_histogram[i] += atomic_load_explicit(&s->wait[i],
+                                                       memory_order_relaxed);
+        out->run_histogram[i] += atomic_load_explicit(&s->run[i],
+                                                      memory_order_relaxed);
+    }
+}
+#endif
+
+static void stats_submit(struct pool_t* p, pu added, pu count)
+{
+#ifdef CTP_STATS
+    stats_add(&p->stats.submitted, added);
+    stats_add(&p->stats.rejected, count - added);
+#else
+    (void)p;
+    (void)added;
+    (void)count;
+#endif
+}
+
+static void stats_block(struct pool_t* p, unsigned long long since)
+{
+#ifdef CTP_STATS
+    stats_add(&p->stats.blocked, 1U);
+    stats_add(&p->stats.block_ns, stats_clock() - since);
+#else
+    (void)p;
+    (void)since;
+#endif
+}
+
+static void stats_idle(struct local_t* local, unsigned long long since)
+{
+#ifdef CTP_STATS
+    stats_add(&local->stats.idle_ns, stats_clock() - since);
+#else
+    (void)local;
+    (void)since;
+#endif
+}
+
+static void stats_stamp(struct worker_t* work, unsigned long long stamp)
+{
+#ifdef CTP_STATS
+    work->stamp = stamp;
+#else
+    (void)work;
+    (void)stamp;
+#endif
+}
+
+static int slab_init(struct slab_t* s, size_t size)
+{
+    const size_t unit = sizeof(union slab_header);
+
+    s->free_list = NULL;
+    s->chunks = NULL;
+    s->size = ((size + unit - 1U) / unit) * unit;
+
+    return pthread_mutex_init(&s->mutex, NULL);
+}
+
+static void slab_destroy(struct slab_t* s)
+{
+    while (s->chunks != NULL) {
+        union slab_header* const chunk = s->chunks;
+        s->chunks = (union slab_header*)chunk->next;
+        free(chunk);
+    }
+    pthread_mutex_destroy(&s->mutex);
+}
+
+static void* slab_alloc(struct slab_t* s)
+{
+    void* obj;
+
+    pthread_mutex_lock(&s->mutex);
+
+    if (s->free_list == NULL) {
+        union slab_header* const chunk = (union slab_header*)
+            malloc(sizeof(union slab_header) + (CTP_SLAB_CHUNK * s->size));
+        if (chunk != NULL) {
+            char* const base = (char*)(chunk + 1);
+            size_t i;
+
+            chunk->next = s->chunks;
+            s->chunks = chunk;
+            for (i = 0U; i < CTP_SLAB_CHUNK; i++) {
+                void** const item = (void**)(base + (i * s->size));
+                *item = s->free_list;
+                s->free_list = item;
+            }
+        }
+    }
+
+    obj = s->free_list;
+    if (obj != NULL) {
+        s->free_list = *(void**)obj;
+    }
+
+    pthread_mutex_unlock(&s->mutex);
+
+    return obj;
+}
+
+static void slab_free(struct slab_t* s, void* obj)
+{
+    pthread_mutex_lock(&s->mutex);
+    *(void**)obj = s->free_list;
+    s->free_list = obj;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+static pu round_queue_size(pu size)
+{
+    pu rounded = 1U;
+
+    while ((rounded < size) && (rounded <= (NON_PAUSED_VALUE >> 1U))) {
+        rounded <<= 1U;
+    }
+
+    return rounded;
+}
+
+static int lfq_push(struct lf_queue_t* q, const struct worker_t* work)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    struct cell_t* cell = NULL;
+    int pushed = -1;
+
+    while ((cell == NULL) && (pushed != 0)) {
+        struct cell_t* const c = &q->cells[pos & q->mask];
+        const size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        const ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos,
+                                                      pos + 1U,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                cell = c;
+            }
+        }
+        else if (diff < 0) {
+            pushed = 0;
+        }
+        else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    if (cell != NULL) {
+        cell->work = *work;
+        atomic_store_explicit(&cell->seq, pos + 1U, memory_order_release);
+    }
+
+    return pushed;
+}
+
+static pu lfq_pop_many(struct lf_queue_t* q, struct worker_t* works, pu max)
+{
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    pu n = 0U;
+    pu i;
+    int owned = 0;
+
+    while (owned == 0) {
+        n = 0U;
+        while ((n < max)
+               && (atomic_load_explicit(&q->cells[(pos + n) & q->mask].seq,
+                                        memory_order_acquire)
+                   == (pos + n + 1U)))
+        {
+            n++;
+        }
+
+        if (n > 0U) {
+            owned = atomic_compare_exchange_weak_explicit(&q->dequeue_pos,
+                                                          &pos, pos + n,
+                                                          memory_order_relaxed,
+                                                          memory_order_relaxed);
+        }
+        else {
+            const size_t seq = atomic_load_explicit(&q->cells[pos & q->mask].seq,
+                                                    memory_order_acquire);
+            if ((ptrdiff_t)(seq - (pos + 1U)) < 0) {
+                owned = -1;
+            }
+            else {
+                pos = atomic_load_explicit(&q->dequeue_pos,
+                                           memory_order_relaxed);
+            }
+        }
+    }
+
+    for (i = 0U; i < n; i++) {
+        struct cell_t* const cell = &q->cells[(pos + i) & q->mask];
+        works[i] = cell->work;
+        atomic_store_explicit(&cell->seq, pos + i + q->mask + 1U,
+                              memory_order_release);
+    }
+
+    return n;
+}
+
+static int lfq_pop(struct lf_queue_t* q, struct worker_t* work)
+{
+    return lfq_pop_many(q, work, 1U) != 0U;
+}
+
+static int lfq_ready(struct lf_queue_t* q)
+{
+    const size_t pos = atomic_load(&q->dequeue_pos);
+    const size_t seq = atomic_load(&q->cells[pos & q->mask].seq);
+    return seq == (pos + 1U);
+}
+
+static pu lfq_count(const struct lf_queue_t* q)
+{
+    const size_t tail = atomic_load_explicit(&q->dequeue_pos,
+                                             memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&q->enqueue_pos,
+                                             memory_order_relaxed);
+    const ptrdiff_t diff = (ptrdiff_t)(head - tail);
+    return (diff > 0) ? (pu)diff : 0U;
+}
+
+static int deque_push(struct deque_t* d, const struct worker_t* work)
+{
+    const size_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    const size_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    int pushed = 0;
+
+    if ((d->buffer != NULL) && ((b - t) < (size_t)CTP_DEQUE_SIZE)) {
+        d->buffer[b & (CTP_DEQUE_SIZE - 1U)] = *work;
+        atomic_store_explicit(&d->bottom, b + 1U, memory_order_release);
+        pushed = -1;
+    }
+
+    return pushed;
+}
+
+static int deque_take(struct deque_t* d, struct worker_t* work)
+{
+    const size_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed)
+        - 1U;
+    size_t t;
+    int taken = 0;
+
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if ((ptrdiff_t)(b - t) >= 0) {
+        *work = d->buffer[b & (CTP_DEQUE_SIZE - 1U)];
+        taken = -1;
+        if (b == t) {
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1U,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed))
+            {
+                taken = 0;
+            }
+            atomic_store_explicit(&d->bottom, b + 1U, memory_order_relaxed);
+        }
+    }
+    else {
+        atomic_store_explicit(&d->bottom, b + 1U, memory_order_relaxed);
+    }
+
+    return taken;
+}
+
+static int deque_steal(struct deque_t* d, struct worker_t* work)
+{
+    size_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    size_t b;
+    int stolen = 0;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if ((ptrdiff_t)(b - t) > 0) {
+        *work = d->buffer[t & (CTP_DEQUE_SIZE - 1U)];
+        stolen = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1U,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed);
+    }
+
+    return stolen;
+}
+
+static pu deque_count(const struct deque_t* d)
+{
+    const size_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    const size_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    const ptrdiff_t diff = (ptrdiff_t)(b - t);
+    return (diff > 0) ? (pu)diff : 0U;
+}
+
+static void make_local_key(void)
+{
+    local_key_error = pthread_key_create(&local_key, NULL);
+}
+
+static struct local_t* get_local(const struct pool_t* p)
+{
+    struct local_t* local = NULL;
+
+    if (p->work_stealing != 0) {
+        local = (struct local_t*)pthread_getspecific(local_key);
+        if ((local != NULL) && (local->pool != p)) {
+            local = NULL;
+        }
+    }
+
+    return local;
+}
+
+static struct local_t* current_local(const struct pool_t* p)
+{
+    struct local_t* local = NULL;
+
+    if (local_key_error == 0) {
+        local = (struct local_t*)pthread_getspecific(local_key);
+        if ((local != NULL) && (local->pool != p)) {
+            local = NULL;
+        }
+    }
+
+    return local;
+}
+
+static int steal_work(struct pool_t* p, struct local_t* self,
+                      struct worker_t* work)
+{
+    const pu n = p->slots;
+    int stolen = 0;
+
+    if (n > 1U) {
+        pu i, victim;
+
+        self->seed ^= self->seed << 13U;
+        self->seed ^= self->seed >> 17U;
+        self->seed ^= self->seed << 5U;
+        victim = self->seed % n;
+
+        for (i = 0U; (i < n) && (stolen == 0); i++) {
+            if (victim != self->index) {
+                stolen = deque_steal(&p->locals[victim]->deque, work);
+            }
+            if (++victim == n) {
+                victim = 0U;
+            }
+        }
+    }
+
+    return stolen;
+}
+
+static pu locals_count(const struct pool_t* p)
+{
+    pu count = 0U;
+
+    if (p->work_stealing != 0) {
+        const pu n = p->slots;
+        pu i;
+
+        for (i = 0U; i < n; i++) {
+            count += deque_count(&p->locals[i]->deque);
+        }
+    }
+
+    return count;
+}
+
+static int claim(_Atomic pu* counter)
+{
+    pu n = atomic_load(counter);
+    int claimed = 0;
+
+    while ((n > 0U) && (claimed == 0)) {
+        claimed = atomic_compare_exchange_weak(counter, &n, n - 1U);
+    }
+
+    return claimed;
+}
+
+static int wake_worker(struct pool_t* p)
+{
+    int woken;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    woken = claim(&p->waiting);
+    if (woken != 0) {
+        sem_post(&p->semaphore);
+    }
+
+    return woken;
+}
+
+static void wake_producer(struct lane_t* lane)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (claim(&lane->blocked) != 0) {
+        sem_post(&lane->sem_add);
+    }
+}
+
+static int lane_ready(struct pool_t* p, struct lane_t* lane)
+{
+    return (p->lock_free != 0) ? lfq_ready(&lane->lfq) : (lane->count > 0U);
+}
+
+static struct lane_t* pick_lane(struct pool_t* p, pu lowest)
+{
+    struct lane_t* lane = NULL;
+    pu i = p->lanes_num;
+
+    if (i > 1U) {
+        const pu tick = atomic_fetch_add(&p->prio_tick, 1U) + 1U;
+
+        if ((tick % CTP_PRIO_AGING) == 0U) {
+            const pu base = (tick / CTP_PRIO_AGING) % p->lanes_num;
+            pu k;
+
+            for (k = 0U; (k < p->lanes_num) && (lane == NULL); k++) {
+                const pu j = (base + k) % p->lanes_num;
+                if (lane_ready(p, &p->lanes[j]) != 0) {
+                    lane = &p->lanes[j];
+                }
+            }
+        }
+
+        while ((lane == NULL) && (i > lowest)) {
+            i--;
+            if (lane_ready(p, &p->lanes[i]) != 0) {
+                lane = &p->lanes[i];
+            }
+        }
+    }
+    else if ((lowest == 0U) && (lane_ready(p, p->lanes) != 0)) {
+        lane = p->lanes;
+    }
+
+    return lane;
+}
+
+static pu batch_size(const struct pool_t* p, pu count)
+{
+    const pu running = p->running;
+    pu n = (running > 1U) ? (count / running) : count;
+
+    if (n == 0U) {
+        n = 1U;
+    }
+    else if (n > p->dequeue_batch) {
+        n = p->dequeue_batch;
+    }
+
+    return n;
+}
+
+static pu take_work(struct pool_t* p, struct local_t* self,
+                    struct worker_t* works)
+{
+    pu found = 0U;
+
+    if (atomic_load(&p->paused) == 0) {
+        struct lane_t* lane = pick_lane(p, (self != NULL) ? 1U : 0U);
+
+        if ((lane == NULL) && (self != NULL)
+            && ((deque_take(&self->deque, works) != 0)
+                || (steal_work(p, self, works) != 0)))
+        {
+            found = 1U;
+        }
+        else {
+            pu i;
+
+            if (lane == NULL) {
+                lane = p->lanes;
+            }
+            found = lfq_pop_many(&lane->lfq, works,
+                                 batch_size(p, lfq_count(&lane->lfq)));
+            for (i = 0U; i < found; i++) {
+                wake_producer(lane);
+            }
+        }
+    }
+
+    return found;
+}
+
+static int has_work(struct pool_t* p)
+{
+    int ready = (locals_count(p) > 0U);
+    pu i;
+
+    for (i = 0U; (i < p->lanes_num) && (ready == 0); i++) {
+        ready = lfq_ready(&p->lanes[i].lfq);
+    }
+
+    return (atomic_load(&p->paused) == 0) && (ready != 0);
+}
+
+static int is_paused(const struct pool_t* p)
+{
+    return (p->lock_free != 0) ? (p->paused != 0)
+                               : (p->old_count != NON_PAUSED_VALUE);
+}
+
+static void broadcast_signal(struct pool_t* p)
+{
+    pthread_mutex_lock(&p->signal_mutex);
+    pthread_cond_broadcast(&p->signal_cond);
+    pthread_mutex_unlock(&p->signal_mutex);
+}
+
+static void count_down(struct pool_t* p, _Atomic pu* counter)
+{
+    if ((atomic_fetch_sub(counter, 1U) == 1U) && (p->done != 0)) {
+        broadcast_signal(p);
+    }
+}
+
+static void wait_zero(struct pool_t* p, _Atomic pu* counter)
+{
+    pthread_mutex_lock(&p->signal_mutex);
+    while (atomic_load(counter) > 0U) {
+        pthread_cond_wait(&p->signal_cond, &p->signal_mutex);
+    }
+    pthread_mutex_unlock(&p->signal_mutex);
+}
+
+static void work_done(struct pool_t* p, pu n)
+{
+    if ((n > 0U) && (atomic_fetch_sub(&p->pending, n) == n)
+        && (p->idle_waiters > 0U))
+    {
+        broadcast_signal(p);
+    }
+}
+
+static void check_watermark(struct pool_t* p)
+{
+    int crossed = (p->high_watermark > 0U);
+
+    while (crossed != 0) {
+        const pu pending = p->pending;
+        int above = atomic_load(&p->above);
+
+        crossed = 0;
+        if ((above == 0) && (pending >= p->high_watermark)
+            && (atomic_compare_exchange_strong(&p->above, &above, 1) != 0))
+        {
+            p->watermark((ctpool_t)p, -1, p->watermark_argument);
+            crossed = -1;
+        }
+        else if ((above != 0) && (pending <= p->low_watermark)
+                 && (atomic_compare_exchange_strong(&p->above, &above, 0)
+                     != 0))
+        {
+            p->watermark((ctpool_t)p, 0, p->watermark_argument);
+            crossed = -1;
+        }
+    }
+}
+
+static void* work_argument(struct worker_t* work)
+{
+#if (CTP_INLINE_PAYLOAD > 0)
+    return (work->payload == PAYLOAD_INLINE) ? (void*)&work->data
+                                             : work->argument;
+#else
+    return work->argument;
+#endif
+}
+
+static void release_payload(struct pool_t* p, struct worker_t* work)
+{
+    if (work->payload >= PAYLOAD_SLAB) {
+        slab_free(&p->payloads[work->payload - PAYLOAD_SLAB], work->argument);
+        work->payload = PAYLOAD_NONE;
+    }
+}
+
+static void call_work(struct pool_t* p, struct local_t* local,
+                      struct worker_t* work)
+{
+    void* const argument = work_argument(work);
+
+    if (work->ex != 0) {
+        const struct local_t* const self = (local != NULL) ? local
+                                                           : current_local(p);
+        work->func_ex((self != NULL) ? self->index : p->threads_num,
+                      (self != NULL) ? self->context : NULL, argument);
+    }
+    else {
+        work->func(argument);
+    }
+
+    release_payload(p, work);
+}
+
+static void run_works(struct pool_t* p, struct local_t* local,
+                      struct worker_t* works, pu n)
+{
+    pu i;
+#ifdef CTP_STATS
+    struct stats_t* const s = (local != NULL) ? &local->stats : &p->stats;
+    unsigned long long start = stats_clock();
+
+    pu ran = 0U;
+
+    for (i = 0U; i < n; i++) {
+        if (works[i].func != NULL) {
+            unsigned long long end;
+
+            stats_add(&s->wait[stats_bucket(start - works[i].stamp)], 1U);
+            call_work(p, local, &works[i]);
+            end = stats_clock();
+            stats_add(&s->run[stats_bucket(end - start)], 1U);
+            stats_add(&s->busy_ns, end - start);
+            start = end;
+            ran++;
+        }
+    }
+    stats_add(&s->completed, ran);
+#else
+    for (i = 0U; i < n; i++) {
+        if (works[i].func != NULL) {
+            call_work(p, local, &works[i]);
+        }
+    }
+#endif
+
+    work_done(p, n);
+    check_watermark(p);
+}
+
+static pu* get_count_ptr(struct pool_t* p)
+{
+    return (p->old_count == NON_PAUSED_VALUE) ? &p->queue_count
+                                              : &p->old_count;
+}
+
+static int grow_lane(struct pool_t* p, struct lane_t* lane)
+{
+    int ok = (lane->last != NULL) && (lane->tail < CTP_SEGMENT_SIZE)
+             && (*get_count_ptr(p) < (NON_PAUSED_VALUE - 1U));
+
+    if ((ok == 0) && (*get_count_ptr(p) < (NON_PAUSED_VALUE - 1U))) {
+        struct segment_t* segment = p->free_segments;
+
+        if (segment != NULL) {
+            p->free_segments = segment->next;
+            p->free_count--;
+        }
+        else if ((p->max_segments == 0U) || (p->segments < p->max_segments)) {
+            segment = (struct segment_t*)malloc(sizeof(struct segment_t));
+            if (segment != NULL) {
+                p->segments++;
+            }
+        }
+
+        if (segment != NULL) {
+            segment->next = NULL;
+            if (lane->last != NULL) {
+                lane->last->next = segment;
+            }
+            else {
+                lane->first = segment;
+                lane->head = 0U;
+            }
+            lane->last = segment;
+            lane->tail = 0U;
+            ok = -1;
+        }
+    }
+
+    return ok;
+}
+
+static void recycle_segment(struct pool_t* p, struct segment_t* segment)
+{
+    if (p->free_count < CTP_SEGMENT_CACHE) {
+        segment->next = p->free_segments;
+        p->free_segments = segment;
+        p->free_count++;
+    }
+    else {
+        free(segment);
+        p->segments--;
+    }
+}
+
+static void wake_space_waiters(struct pool_t* p)
+{
+    if (p->space_waiters > 0U) {
+        pthread_cond_broadcast(&p->space_cond);
+    }
+}
+
+static int lane_room(struct pool_t* p, struct lane_t* lane)
+{
+    return (p->unbounded != 0) ? (grow_lane(p, lane) != 0)
+                               : ((lane->count < lane->size)
+                                  && (sem_trywait(&lane->sem_add) == 0));
+}
+
+static void set_slot(struct worker_t* slot, const ctp_work_t* work,
+                     const struct worker_t* model)
+{
+    if (model != NULL) {
+        *slot = *model;
+    }
+    else {
+        slot->func = work->func;
+        slot->tag = NULL;
+        slot->payload = PAYLOAD_NONE;
+        slot->ex = 0;
+    }
+    slot->argument = work->argument;
+}
+
+static void push_locked(struct pool_t* p, struct lane_t* lane,
+                        const ctp_work_t* work, const struct worker_t* model,
+                        unsigned long long stamp)
+{
+    struct worker_t* slot;
+    pu* p_count;
+
+    if (p->unbounded != 0) {
+        slot = &lane->last->works[lane->tail];
+        lane->tail++;
+    }
+    else {
+        pu index = lane->head + lane->count;
+        if (index >= lane->size) {
+            index -= lane->size;
+        }
+        slot = &lane->queue[index];
+    }
+
+    set_slot(slot, work, model);
+    stats_stamp(slot, stamp);
+    lane->count++;
+    p_count = get_count_ptr(p);
+    *p_count = *p_count + 1U;
+}
+
+static void pop_segmented(struct pool_t* p, struct lane_t* lane,
+                          struct worker_t* works, pu n)
+{
+    pu i;
+
+    for (i = 0U; i < n; i++) {
+        works[i] = lane->first->works[lane->head];
+        lane->head++;
+        lane->count--;
+
+        if (lane->count == 0U) {
+            lane->head = 0U;
+            lane->tail = 0U;
+            wake_space_waiters(p);
+        }
+        else if (lane->head == CTP_SEGMENT_SIZE) {
+            struct segment_t* const segment = lane->first;
+            lane->first = segment->next;
+            lane->head = 0U;
+            recycle_segment(p, segment);
+            wake_space_waiters(p);
+        }
+    }
+}
+
+static pu pop_locked(struct pool_t* p, struct worker_t* works)
+{
+    struct lane_t* const lane = pick_lane(p, 0U);
+    pu n = batch_size(p, p->queue_count);
+    pu i;
+
+    if (n > lane->count) {
+        n = lane->count;
+    }
+
+    if (p->unbounded != 0) {
+        pop_segmented(p, lane, works, n);
+    }
+    else {
+        for (i = 0U; i < n; i++) {
+            works[i] = lane->queue[lane->head];
+            if (++lane->head == lane->size) {
+                lane->head = 0U;
+            }
+            sem_post(&lane->sem_add);
+        }
+        lane->count -= n;
+        if (lane->count == 0U) {
+            lane->head = 0U;
+        }
+    }
+    p->queue_count -= n;
+
+    return n;
+}
+
+static void cpu_relax(void)
+{
+#if (defined(__GNUC__)) && ((defined(__x86_64__)) || (defined(__i386__)))
+    __builtin_ia32_pause();
+#elif (defined(__GNUC__)) && (defined(__aarch64__))
+    __asm__ __volatile__("yield");
+#elif defined(_MSC_VER)
+    YieldProcessor();
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+static int can_spin(const struct pool_t* p, const struct local_t* local)
+{
+    return (local->spin_budget > 0U) || (p->yield_count > 0U);
+}
+
+static void idle_spin(struct pool_t* p, const struct local_t* local)
+{
+    const pu pending = p->pending;
+    pu spins = local->spin_budget;
+    pu yields = p->yield_count;
+    int found = 0;
+
+    while ((found == 0) && ((spins > 0U) || (yields > 0U))) {
+        if (spins > 0U) {
+            cpu_relax();
+            spins--;
+        }
+        else {
+            sched_yield();
+            yields--;
+        }
+        found = (p->done != 0) || ((p->lock_free != 0) ? has_work(p)
+                                                       : (p->pending != pending));
+    }
+}
+
+static void idle_tune(struct pool_t* p, struct local_t* local, int hit)
+{
+    if (hit != 0) {
+        p->wakeups_avoided++;
+        local->spin_budget = (local->spin_budget > (p->spin_count / 2U)) ?
+            p->spin_count : (local->spin_budget * 2U);
+    }
+    else {
+        const pu floor = (p->spin_count + 7U) / 8U;
+        local->spin_budget = ((local->spin_budget / 2U) > floor) ?
+            (local->spin_budget / 2U) : floor;
+    }
+}
+
+static void timer_link(struct pool_t* p, pu index, pu list)
+{
+    struct timer_node_t* const t = &p->timers[index];
+
+    t->list = list;
+    t->prev = TIMER_NONE;
+    t->next = p->timer_heads[list];
+    if (t->next != TIMER_NONE) {
+        p->timers[t->next].prev = index;
+    }
+    p->timer_heads[list] = index;
+
+    if (list < TIMER_READY) {
+        p->wheel_bits[list / WHEEL_SLOTS] |= 1ULL << (list % WHEEL_SLOTS);
+        p->wheel_count++;
+    }
+}
+
+static void timer_unlink(struct pool_t* p, pu index)
+{
+    struct timer_node_t* const t = &p->timers[index];
+    const pu list = t->list;
+
+    if (t->prev != TIMER_NONE) {
+        p->timers[t->prev].next = t->next;
+    }
+    else {
+        p->timer_heads[list] = t->next;
+    }
+    if (t->next != TIMER_NONE) {
+        p->timers[t->next].prev = t->prev;
+    }
+
+    if (list < TIMER_READY) {
+        p->wheel_count--;
+        if (p->timer_heads[list] == TIMER_NONE) {
+            p->wheel_bits[list / WHEEL_SLOTS] &= ~(1ULL << (list % WHEEL_SLOTS));
+        }
+    }
+
+    t->list = TIMER_NONE;
+}
+
+static void timer_place(struct pool_t* p, pu index)
+{
+    const unsigned long long due = p->timers[index].due;
+    pu list = TIMER_READY;
+
+    if (due > p->wheel_now) {
+        unsigned long long ahead = due - p->wheel_now;
+        pu level = 0U;
+
+        while ((level < WHEEL_LEVELS) && (ahead >= WHEEL_SLOTS)) {
+            level++;
+            ahead = (due >> (WHEEL_BITS * level))
+                    - (p->wheel_now >> (WHEEL_BITS * level));
+        }
+        if (level == WHEEL_LEVELS) {
+            level = WHEEL_LEVELS - 1U;
+            ahead = WHEEL_SLOTS - 1U;
+        }
+
+        list = (level * WHEEL_SLOTS)
+               + (pu)(((p->wheel_now >> (WHEEL_BITS * level)) + ahead)
+                      & (WHEEL_SLOTS - 1U));
+    }
+
+    timer_link(p, index, list);
+}
+
+static unsigned long long wheel_next(const struct pool_t* p)
+{
+    unsigned long long next = TIMER_NEVER;
+    pu level;
+
+    for (level = 0U; level < WHEEL_LEVELS; level++) {
+        if (p->wheel_bits[level] != 0U) {
+            const unsigned long long base = p->wheel_now
+                                            >> (WHEEL_BITS * level);
+            pu k = 1U;
+
+            while ((k < WHEEL_SLOTS)
+                   && ((p->wheel_bits[level]
+                        & (1ULL << ((base + k) & (WHEEL_SLOTS - 1U)))) == 0U))
+            {
+                k++;
+            }
+            if ((k < WHEEL_SLOTS)
+                && (((base + k) << (WHEEL_BITS * level)) < next))
+            {
+                next = (base + k) << (WHEEL_BITS * level);
+            }
+        }
+    }
+
+    return next;
+}
+
+static unsigned long long timer_next_event(const struct pool_t* p)
+{
+    return (p->timer_heads[TIMER_READY] != TIMER_NONE) ? p->wheel_now
+                                                       : wheel_next(p);
+}
+
+static void timer_advance(struct pool_t* p, unsigned long long target)
+{
+    unsigned long long event = (p->wheel_count > 0U) ? wheel_next(p)
+                                                     : TIMER_NEVER;
+
+    while (event <= target) {
+        pu level;
+
+        p->wheel_now = event;
+
+        for (level = WHEEL_LEVELS - 1U; level > 0U; level--) {
+            if ((event & ((1ULL << (WHEEL_BITS * level)) - 1U)) == 0U) {
+                const pu list = (level * WHEEL_SLOTS)
+                                + (pu)((event >> (WHEEL_BITS * level))
+                                       & (WHEEL_SLOTS - 1U));
+                while (p->timer_heads[list] != TIMER_NONE) {
+                    const pu index = p->timer_heads[list];
+                    timer_unlink(p, index);
+                    timer_place(p, index);
+                }
+            }
+        }
+
+        while (p->timer_heads[event & (WHEEL_SLOTS - 1U)] != TIMER_NONE) {
+            const pu index = p->timer_heads[event & (WHEEL_SLOTS - 1U)];
+            timer_unlink(p, index);
+            timer_link(p, index, TIMER_READY);
+        }
+
+        event = (p->wheel_count > 0U) ? wheel_next(p) : TIMER_NEVER;
+    }
+
+    if (target > p->wheel_now) {
+        p->wheel_now = target;
+    }
+}
+
+static void timer_free(struct pool_t* p, pu index)
+{
+    struct timer_node_t* const t = &p->timers[index];
+
+    t->generation++;
+    t->list = TIMER_NONE;
+    t->next = p->timer_free;
+    p->timer_free = index;
+    p->timers_num--;
+}
+
+static pu timer_collect(struct pool_t* p, struct worker_t* works, pu max)
+{
+    const unsigned long long now = now_ms();
+    const unsigned long long stamp = stats_clock();
+    pu n = 0U;
+
+    timer_advance(p, now);
+
+    while ((n < max) && (p->timer_heads[TIMER_READY] != TIMER_NONE)) {
+        const pu index = p->timer_heads[TIMER_READY];
+        struct timer_node_t* const t = &p->timers[index];
+
+        timer_unlink(p, index);
+        works[n].func = t->func;
+        works[n].argument = t->argument;
+        works[n].tag = NULL;
+        works[n].payload = PAYLOAD_NONE;
+        works[n].ex = 0;
+        stats_stamp(&works[n], stamp);
+        n++;
+
+        if (t->period > 0U) {
+            t->due += t->period;
+            if (t->due <= now) {
+                t->due += (((now - t->due) / t->period) + 1U) * t->period;
+            }
+            timer_place(p, index);
+        }
+        else {
+            timer_free(p, index);
+        }
+    }
+
+    atomic_store(&p->timer_next, timer_next_event(p));
+
+    return n;
+}
+
+static void queue_timers(struct pool_t* p, struct local_t* local,
+                         struct worker_t* works, pu n)
+{
+    struct lane_t* const lane = p->lanes;
+    pu added = 0U;
+    pu rejected = 0U;
+    pu i;
+
+    if (p->lock_free != 0) {
+        p->pending += n;
+        for (i = 0U; i < n; i++) {
+            if (lfq_push(&lane->lfq, &works[i]) != 0) {
+                added++;
+            }
+            else {
+                works[rejected] = works[i];
+                rejected++;
+            }
+        }
+        for (i = 0U; (i < added) && (atomic_load(&p->paused) == 0)
+                     && (wake_worker(p) != 0); i++)
+        {
+        }
+    }
+    else {
+        pthread_mutex_lock(&p->mutex);
+        p->pending += n;
+        for (i = 0U; i < n; i++) {
+            if (lane_room(p, lane) != 0) {
+                ctp_work_t work;
+                work.func = works[i].func;
+                work.argument = works[i].argument;
+                push_locked(p, lane, &work, NULL, stats_clock());
+                added++;
+            }
+            else {
+                works[rejected] = works[i];
+                rejected++;
+            }
+        }
+        for (i = 0U; (i < added) && (i < p->waiting)
+                     && (p->old_count == NON_PAUSED_VALUE); i++)
+        {
+            sem_post(&p->semaphore);
+        }
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    run_works(p, local, works, rejected);
+}
+
+static void fire_timers(struct pool_t* p, struct local_t* local)
+{
+    if ((p->timers_num > 0U) && (p->done == 0)
+        && (now_ms() >= atomic_load(&p->timer_next)))
+    {
+        struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+        pu n = CTP_MAX_DEQUEUE_BATCH;
+
+        while ((n == CTP_MAX_DEQUEUE_BATCH)
+               && (pthread_mutex_trylock(&p->timer_mutex) == 0))
+        {
+            n = timer_collect(p, works, CTP_MAX_DEQUEUE_BATCH);
+            pthread_mutex_unlock(&p->timer_mutex);
+            queue_timers(p, local, works, n);
+        }
+    }
+}
+
+static unsigned long long timer_sleep_begin(struct pool_t* p)
+{
+    unsigned long long wake = TIMER_NEVER;
+
+    if (p->timers_num > 0U) {
+        pthread_mutex_lock(&p->timer_mutex);
+        if (atomic_load(&p->timer_next) < p->timer_sleep) {
+            p->timer_sleep = atomic_load(&p->timer_next);
+            wake = p->timer_sleep;
+        }
+        pthread_mutex_unlock(&p->timer_mutex);
+    }
+
+    return wake;
+}
+
+static void timer_sleep_end(struct pool_t* p, unsigned long long wake,
+                            int parked)
+{
+    if (wake != TIMER_NEVER) {
+        int handoff;
+
+        pthread_mutex_lock(&p->timer_mutex);
+        if (p->timer_sleep == wake) {
+            p->timer_sleep = TIMER_NEVER;
+        }
+        handoff = (parked == PARK_WOKEN) && (p->timers_num > 0U);
+        pthread_mutex_unlock(&p->timer_mutex);
+
+        if ((handoff != 0) && (p->lock_free != 0)) {
+            wake_worker(p);
+        }
+        else if (handoff != 0) {
+            pthread_mutex_lock(&p->mutex);
+            if (p->waiting > 1U) {
+                sem_post(&p->semaphore);
+            }
+            pthread_mutex_unlock(&p->mutex);
+        }
+    }
+}
+
+static int park(struct pool_t* p)
+{
+    const unsigned long long wake = timer_sleep_begin(p);
+    int parked = PARK_WOKEN;
+
+    if ((p->keep_alive_ms > 0U) || (wake != TIMER_NEVER)) {
+        const unsigned long long now = now_ms();
+        const unsigned long long alive = now + p->keep_alive_ms;
+        unsigned long long until = wake;
+        struct timespec ts;
+        int error;
+
+        if ((p->keep_alive_ms > 0U) && (alive < until)) {
+            until = alive;
+        }
+        get_deadline_us(&ts, (until > now) ? ((until - now) * 1000U) : 0U);
+
+        do {
+            error = sem_timedwait(&p->semaphore, &ts);
+        } while ((error != 0) && (errno == EINTR));
+
+        if (error != 0) {
+            parked = (until == wake) ? PARK_TIMER : PARK_EXPIRED;
+        }
+    }
+    else {
+        sem_wait(&p->semaphore);
+    }
+
+    timer_sleep_end(p, wake, parked);
+
+    return parked;
+}
+
+static int can_retire(const struct pool_t* p, const struct local_t* local)
+{
+    return (p->keep_alive_ms > 0U) && (p->done == 0)
+           && (p->running > p->min_threads) && (is_paused(p) == 0)
+           && ((p->timers_num == 0U) || (p->running > 1U))
+           && (local->state == SLOT_LIVE);
+}
+
+static int may_retire(struct pool_t* p, const struct local_t* local)
+{
+    int retire;
+
+    pthread_mutex_lock(&p->mutex);
+    retire = can_retire(p, local);
+    pthread_mutex_unlock(&p->mutex);
+
+    return retire;
+}
+
+static int retire_thread(struct pool_t* p, struct local_t* local)
+{
+    int retired = 0;
+
+    pthread_mutex_lock(&p->mutex);
+
+    if (can_retire(p, local) != 0) {
+        p->running--;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (((p->lock_free != 0) ? has_work(p) : (p->queue_count > 0U)) != 0) {
+            p->running++;
+        }
+        else {
+            local->state = SLOT_RETIRED;
+            retired = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&p->mutex);
+
+    return retired;
+}
+
+static int run_lock_free(struct pool_t* p, struct local_t* local)
+{
+    struct local_t* self = NULL;
+    struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+    int retiring = 0;
+    int spun = 0;
+    pu n;
+
+    if (p->work_stealing != 0) {
+        if (local->deque.buffer == NULL) {
+            local->deque.buffer = (struct worker_t*)
+                malloc(sizeof(struct worker_t) * CTP_DEQUE_SIZE);
+        }
+        self = local;
+    }
+
+    for (;;) {
+        fire_timers(p, local);
+
+        n = take_work(p, self, works);
+        if (n > 0U) {
+            if (spun != 0) {
+                idle_tune(p, local, -1);
+                spun = 0;
+            }
+            run_works(p, local, works, n);
+        }
+        else if (p->done != 0) {
+            break;
+        }
+        else if ((spun == 0) && (can_spin(p, local) != 0)) {
+            const unsigned long long since = stats_clock();
+            idle_spin(p, local);
+            stats_idle(local, since);
+            spun = -1;
+        }
+        else {
+            const unsigned long long since = stats_clock();
+
+            if (spun != 0) {
+                idle_tune(p, local, 0);
+                spun = 0;
+            }
+
+            p->waiting++;
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if ((p->done != 0) || (has_work(p) != 0)) {
+                if (claim(&p->waiting) == 0) {
+                    sem_wait(&p->semaphore);
+                }
+            }
+            else {
+                const int parked = park(p);
+
+                if (parked != PARK_WOKEN) {
+                    if (claim(&p->waiting) == 0) {
+                        sem_wait(&p->semaphore);
+                    }
+                    else if ((parked == PARK_EXPIRED)
+                             && (may_retire(p, local) != 0))
+                    {
+                        stats_idle(local, since);
+                        retiring = -1;
+                        break;
+                    }
+                }
+            }
+
+            stats_idle(local, since);
+        }
+    }
+
+    if (retiring == 0) {
+        pthread_mutex_lock(&p->mutex);
+    }
+
+    return retiring;
+}
+
+static int run_locked(struct pool_t* p, struct local_t* local)
+{
+    struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+    int retiring = 0;
+    int must_sleep = 0;
+    int timed_out = 0;
+    int spun = 0;
+
+    for (;;) {
+        fire_timers(p, local);
+
+        pthread_mutex_lock(&p->mutex);
+
+        if (must_sleep != 0) {
+            p->waiting--;
+        }
+
+        must_sleep = (p->queue_count == 0U);
+
+        if ((must_sleep != 0) && (timed_out != 0)
+            && (can_retire(p, local) != 0))
+        {
+            pthread_mutex_unlock(&p->mutex);
+            retiring = -1;
+            break;
+        }
+        timed_out = 0;
+
+        if (must_sleep == 0) {
+            const pu n = pop_locked(p, works);
+
+            pthread_mutex_unlock(&p->mutex);
+
+            if (spun != 0) {
+                idle_tune(p, local, -1);
+                spun = 0;
+            }
+
+            run_works(p, local, works, n);
+        }
+        else {
+            if (p->done != 0) {
+                break;
+            }
+            else if ((spun == 0) && (can_spin(p, local) != 0)) {
+                const unsigned long long since = stats_clock();
+                pthread_mutex_unlock(&p->mutex);
+                idle_spin(p, local);
+                stats_idle(local, since);
+                spun = -1;
+                must_sleep = 0;
+            }
+            else {
+                const unsigned long long since = stats_clock();
+
+                if (spun != 0) {
+                    idle_tune(p, local, 0);
+                    spun = 0;
+                }
+                p->waiting++;
+                pthread_mutex_unlock(&p->mutex);
+                timed_out = (park(p) == PARK_EXPIRED);
+                stats_idle(local, since);
+            }
+        }
+    }
+
+    return retiring;
+}
+
+static void* run(void* arg)
+{
+    struct local_t* const local = (struct local_t*)arg;
+    struct pool_t* const p = local->pool;
+    int retired = 0;
+
+    if (local_key_error == 0) {
+        pthread_setspecific(local_key, local);
+    }
+
+    while (retired == 0) {
+        int retiring;
+
+        local->context = (p->thread_start != NULL) ?
+            p->thread_start(local->index, p->hook_argument) : NULL;
+
+        retiring = (p->lock_free != 0) ? run_lock_free(p, local)
+                                       : run_locked(p, local);
+        if (retiring == 0) {
+            p->running--;
+            pthread_mutex_unlock(&p->mutex);
+        }
+
+        if (p->thread_exit != NULL) {
+            p->thread_exit(local->index, local->context, p->hook_argument);
+        }
+
+        retired = (retiring == 0) || (retire_thread(p, local) != 0);
+    }
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+static struct local_t* reserve_thread(struct pool_t* p)
+{
+    struct local_t* local = NULL;
+
+    if ((p->done == 0) && (p->running < p->threads_num)) {
+        pu slot = 0U;
+
+        while ((slot < p->slots) && ((p->locals[slot]->state == SLOT_LIVE)
+                                     || (p->locals[slot]->state
+                                         == SLOT_STARTING)))
+        {
+            slot++;
+        }
+
+        local = p->locals[slot];
+        if ((local != NULL) && (local->state == SLOT_RETIRED)) {
+            pthread_join(p->threads[slot], NULL);
+            local->state = SLOT_FREE;
+        }
+
+        if (local == NULL) {
+            local = (struct local_t*)malloc(sizeof(struct local_t));
+            if (local != NULL) {
+                atomic_init(&local->deque.top, 0U);
+                atomic_init(&local->deque.bottom, 0U);
+                local->deque.buffer = NULL;
+                local->pool = p;
+                local->index = slot;
+                local->seed = slot + 1U;
+                local->spin_budget = p->spin_count;
+                atomic_init(&local->state, SLOT_FREE);
+#ifdef CTP_STATS
+                stats_init(&local->stats);
+#endif
+                p->locals[slot] = local;
+            }
+        }
+
+        if (local != NULL) {
+            local->state = SLOT_STARTING;
+            local->next = NULL;
+            p->running++;
+            p->spawning++;
+            if (slot == p->slots) {
+                p->slots++;
+            }
+        }
+    }
+
+    return local;
+}
+
+static void release_thread(struct pool_t* p, struct local_t* local)
+{
+    local->state = SLOT_FREE;
+    p->running--;
+}
+
+static int launch_thread(struct pool_t* p, struct local_t* local)
+{
+    pthread_attr_t* used = NULL;
+    int error = 0;
+#ifdef CTP_HAS_AFFINITY
+    pthread_attr_t attr;
+
+    if (p->cpusets != NULL) {
+        error = pthread_attr_init(&attr);
+        if (error == 0) {
+            used = &attr;
+            error = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t),
+                                                &p->cpusets[local->index]);
+        }
+    }
+#endif
+
+    if (error == 0) {
+        error = pthread_create(&p->threads[local->index], used, run, local);
+    }
+    if (used != NULL) {
+        pthread_attr_destroy(used);
+    }
+
+    if (error == 0) {
+        local->state = SLOT_LIVE;
+        count_down(p, &p->spawning);
+    }
+
+    return error;
+}
+
+static void start_threads(struct pool_t* p, struct local_t* list)
+{
+    while (list != NULL) {
+        struct local_t* const local = list;
+
+        list = local->next;
+        if (launch_thread(p, local) != 0) {
+            pthread_mutex_lock(&p->mutex);
+            release_thread(p, local);
+            pthread_mutex_unlock(&p->mutex);
+            count_down(p, &p->spawning);
+        }
+    }
+}
+
+static int spawn_thread(struct pool_t* p)
+{
+    struct local_t* local;
+
+    pthread_mutex_lock(&p->mutex);
+    local = reserve_thread(p);
+    pthread_mutex_unlock(&p->mutex);
+
+    start_threads(p, local);
+
+    return p->running > 0U;
+}
+
+static void close_notify(struct pool_t* p)
+{
+#ifdef CTP_HAS_NOTIFY_FD
+    if (p->notify_fd[0] >= 0) {
+        close(p->notify_fd[0]);
+    }
+    if (p->notify_fd[1] != p->notify_fd[0]) {
+        close(p->notify_fd[1]);
+    }
+#else
+    (void)p;
+#endif
+}
+
+static int open_notify(struct pool_t* p)
+{
+    int ok = 0;
+
+    p->notify_fd[0] = -1;
+    p->notify_fd[1] = -1;
+
+    if (p->notify == 0) {
+        ok = -1;
+    }
+    else {
+#if defined(CTP_HAS_EVENTFD)
+        p->notify_fd[0] = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+        p->notify_fd[1] = p->notify_fd[0];
+        ok = (p->notify_fd[0] >= 0);
+#elif defined(CTP_HAS_NOTIFY_FD)
+        if (pipe(p->notify_fd) == 0) {
+            fcntl(p->notify_fd[0], F_SETFL, O_NONBLOCK);
+            fcntl(p->notify_fd[1], F_SETFL, O_NONBLOCK);
+            fcntl(p->notify_fd[0], F_SETFD, FD_CLOEXEC);
+            fcntl(p->notify_fd[1], F_SETFD, FD_CLOEXEC);
+            ok = -1;
+        }
+#endif
+    }
+
+    return ok;
+}
+
+static int init_completions(struct pool_t* p)
+{
+    int ok = 0;
+
+    if (slab_init(&p->completions, sizeof(struct completion_t)) == 0) {
+        struct completion_t* const stub =
+            (struct completion_t*)slab_alloc(&p->completions);
+
+        if ((stub != NULL) && (open_notify(p) != 0)) {
+            atomic_init(&stub->next, NULL);
+            atomic_init(&p->completion_tail, stub);
+            p->completion_head = stub;
+            atomic_init(&p->completion_armed, 1);
+            ok = -1;
+        }
+        else {
+            slab_destroy(&p->completions);
+        }
+    }
+
+    return ok;
+}
+
+static void free_resources(struct pool_t* p, int level)
+{
+#ifdef CTP_HAS_AFFINITY
+    free(p->cpusets);
+#endif
+    if (level >= 2) {
+        pu i;
+        for (i = 0U; (i < p->threads_num) && (p->locals[i] != NULL); i++) {
+            free(p->locals[i]->deque.buffer);
+            free(p->locals[i]);
+        }
+        free(p->threads);
+        free(p->locals);
+    }
+    if (level >= 3) {
+        pu i;
+        for (i = 0U; i < p->lanes_ready; i++) {
+            while (p->lanes[i].first != NULL) {
+                struct segment_t* const segment = p->lanes[i].first;
+                p->lanes[i].first = segment->next;
+                free(segment);
+            }
+            free(p->lanes[i].queue);
+            free(p->lanes[i].lfq.cells);
+            sem_destroy(&p->lanes[i].sem_add);
+        }
+        while (p->free_segments != NULL) {
+            struct segment_t* const segment = p->free_segments;
+            p->free_segments = segment->next;
+            free(segment);
+        }
+        free(p->lanes);
+    }
+    if (level >= 4) {
+        pthread_mutex_destroy(&p->mutex);
+    }
+    if (level >= 5) {
+        sem_destroy(&p->semaphore);
+    }
+    if (level >= 6) {
+        slab_destroy(&p->futures);
+    }
+    if (level >= 7) {
+        pthread_mutex_destroy(&p->signal_mutex);
+    }
+    if (level >= 8) {
+        pthread_cond_destroy(&p->signal_cond);
+    }
+    if (level >= 9) {
+        pthread_cond_destroy(&p->space_cond);
+    }
+    if (level >= 10) {
+        pthread_mutex_destroy(&p->timer_mutex);
+        free(p->timers);
+    }
+    if (level >= 11) {
+        pu i;
+        for (i = 0U; i < PAYLOAD_CLASSES; i++) {
+            slab_destroy(&p->payloads[i]);
+        }
+    }
+    if (level >= 12) {
+        close_notify(p);
+        slab_destroy(&p->completions);
+    }
+
+    free(p);
+}
+
+static void init_timers(struct pool_t* p)
+{
+    pu i;
+
+    p->timers = NULL;
+    p->timers_size = 0U;
+    p->timer_free = TIMER_NONE;
+    atomic_init(&p->timers_num, 0U);
+    p->wheel_count = 0U;
+    p->wheel_now = now_ms();
+    p->timer_sleep = TIMER_NEVER;
+    atomic_init(&p->timer_next, TIMER_NEVER);
+    for (i = 0U; i < WHEEL_LEVELS; i++) {
+        p->wheel_bits[i] = 0U;
+    }
+    for (i = 0U; i <= TIMER_READY; i++) {
+        p->timer_heads[i] = TIMER_NONE;
+    }
+}
+
+static int init_payloads(struct pool_t* p)
+{
+    pu i = 0U;
+
+    while ((i < PAYLOAD_CLASSES)
+           && (slab_init(&p->payloads[i], (size_t)PAYLOAD_MIN << i) == 0))
+    {
+        i++;
+    }
+    if (i < PAYLOAD_CLASSES) {
+        while (i > 0U) {
+            i--;
+            slab_destroy(&p->payloads[i]);
+        }
+    }
+
+    return i == PAYLOAD_CLASSES;
+}
+
+static int init_signals(struct pool_t* p)
+{
+    int level = 0;
+
+    if (slab_init(&p->futures, sizeof(struct ctp_future)) == 0) {
+        level++;
+
+        if (pthread_mutex_init(&p->signal_mutex, NULL) == 0) {
+            level++;
+
+            if (pthread_cond_init(&p->signal_cond, NULL) == 0) {
+                level++;
+
+                if (pthread_cond_init(&p->space_cond, NULL) == 0) {
+                    level++;
+
+                    if (pthread_mutex_init(&p->timer_mutex, NULL) == 0) {
+                        level++;
+
+                        if (init_payloads(p) != 0) {
+                            level++;
+
+                            if (init_completions(p) != 0) {
+                                level++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return level;
+}
+
+static int alloc_queue(struct pool_t* p, struct lane_t* lane, int touch)
+{
+    int ok;
+
+    lane->queue = NULL;
+    lane->first = NULL;
+    lane->last = NULL;
+    lane->tail = 0U;
+    lane->lfq.cells = NULL;
+
+    if (p->unbounded != 0) {
+        lane->size = (p->max_segments > 0U)
+                     && (p->max_segments
+                         <= ((NON_PAUSED_VALUE - 1U) / CTP_SEGMENT_SIZE)) ?
+            (p->max_segments * CTP_SEGMENT_SIZE) : (NON_PAUSED_VALUE - 1U);
+        ok = -1;
+    }
+    else if (p->lock_free != 0) {
+        lane->size = round_queue_size(lane->size);
+        lane->lfq.cells = (struct cell_t*)malloc(sizeof(struct cell_t)
+                                                 * (size_t)(lane->size));
+        ok = (lane->lfq.cells != NULL);
+        if (ok != 0) {
+            size_t i;
+            for (i = 0U; i < (size_t)lane->size; i++) {
+                atomic_init(&lane->lfq.cells[i].seq, i);
+            }
+            lane->lfq.mask = (size_t)lane->size - 1U;
+            atomic_init(&lane->lfq.enqueue_pos, 0U);
+            atomic_init(&lane->lfq.dequeue_pos, 0U);
+        }
+    }
+    else {
+        lane->queue = (struct worker_t*) malloc(sizeof(struct worker_t)
+                                                * (size_t)(lane->size));
+        ok = (lane->queue != NULL);
+        if ((ok != 0) && (touch != 0)) {
+            memset(lane->queue, 0, sizeof(struct worker_t)
+                                   * (size_t)(lane->size));
+        }
+    }
+
+    if ((ok != 0) && (sem_init(&lane->sem_add, 0,
+                               ((p->lock_free != 0) || (p->unbounded != 0)) ?
+                               0U : lane->size) != 0))
+    {
+        free(lane->queue);
+        free(lane->lfq.cells);
+        ok = 0;
+    }
+
+    return ok;
+}
+
+static int alloc_lanes(struct pool_t* p, const ctp_options_t* options,
+                       pu size)
+{
+    int touch = 0;
+    int ok;
+#ifdef CTP_HAS_AFFINITY
+    cpu_set_t saved;
+
+    if ((p->affinity == CTP_AFFINITY_NODE)
+        && (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                   &saved) == 0)
+        && (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                   p->cpusets) == 0))
+    {
+        touch = -1;
+    }
+#endif
+
+    p->lanes_num = (options->priorities > 1U) ? options->priorities : 1U;
+    p->lanes_ready = 0U;
+    p->queue_size = 0U;
+    p->lanes = (struct lane_t*)malloc(sizeof(struct lane_t)
+                                      * (size_t)p->lanes_num);
+    ok = (p->lanes != NULL);
+
+    while ((ok != 0) && (p->lanes_ready < p->lanes_num)) {
+        struct lane_t* const lane = &p->lanes[p->lanes_ready];
+
+        lane->size = size;
+        if ((options->priority_sizes != NULL)
+            && (options->priority_sizes[p->lanes_ready] > 0U))
+        {
+            lane->size = options->priority_sizes[p->lanes_ready];
+        }
+        if (lane->size == NON_PAUSED_VALUE) {
+            lane->size--;
+        }
+        lane->count = 0U;
+        lane->head = 0U;
+        atomic_init(&lane->blocked, 0U);
+
+        ok = alloc_queue(p, lane, touch);
+        if (ok != 0) {
+            p->lanes_ready++;
+            p->queue_size += lane->size;
+            if ((p->queue_size < lane->size)
+                || (p->queue_size == NON_PAUSED_VALUE))
+            {
+                p->queue_size = NON_PAUSED_VALUE - 1U;
+            }
+        }
+    }
+
+#ifdef CTP_HAS_AFFINITY
+    if ((touch != 0)
+        && (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                   &saved) != 0))
+    {
+        ok = 0;
+    }
+#endif
+
+    return ok;
+}
+
+void ctp_options_init(ctp_options_t* options)
+{
+    options->threads_num = 0U;
+    options->queue_size = 0U;
+    options->block = 0;
+    options->caller_runs = 0;
+    options->thread_start = NULL;
+    options->thread_exit = NULL;
+    options->hook_argument = NULL;
+    options->high_watermark = 0U;
+    options->low_watermark = 0U;
+    options->watermark = NULL;
+    options->watermark_argument = NULL;
+    options->completions = 0;
+    options->blocking_threads = 0U;
+    options->lock_free = 0;
+    options->work_stealing = 0;
+    options->dequeue_batch = 1U;
+    options->priorities = 1U;
+    options->priority_sizes = NULL;
+    options->affinity = CTP_AFFINITY_NONE;
+    options->cpus = NULL;
+    options->cpus_num = 0U;
+    options->numa_node = 0U;
+    options->spin_count = 0U;
+    options->yield_count = 0U;
+    options->min_threads = 0U;
+    options->keep_alive_ms = 0U;
+    options->eager = 0;
+    options->unbounded = 0;
+    options->queue_memory_cap = 0U;
+}
+
+ctpool_t ctp_init(unsigned int threads_num, unsigned int queue_size, int block)
+{
+    ctp_options_t options;
+
+    ctp_options_init(&options);
+    options.threads_num = threads_num;
+    options.queue_size = queue_size;
+    options.block = block;
+
+    return ctp_init_ex(&options);
+}
+
+ctpool_t ctp_init_ex(const ctp_options_t* options)
+{
+    int level = 0;
+
+    struct pool_t* p = (struct pool_t*)malloc(sizeof(struct pool_t));
+    if ((p != NULL) && (init_affinity(p, options) != 0)) {
+        free(p);
+        p = NULL;
+    }
+    if (p != NULL) {
+        level++;
+
+        p->threads = (pthread_t*)malloc(sizeof(pthread_t)
+                                        * (size_t)p->threads_num);
+        p->locals = (struct local_t**)calloc((size_t)p->threads_num,
+                                             sizeof(struct local_t*));
+        pthread_once(&local_once, make_local_key);
+        if ((p->threads != NULL) && (p->locals != NULL)
+            && ((options->work_stealing == 0) || (local_key_error == 0)))
+        {
+            pu size;
+
+            level++;
+
+            if (options->queue_size > 0U) {
+                size = options->queue_size;
+            }
+            else {
+                size = p->threads_num * CTP_MULTIPLY_QUEUE_FACTOR;
+                if (size < CTP_MIN_QUEUE_SIZE) {
+                    size = CTP_MIN_QUEUE_SIZE;
+                }
+            }
+
+            p->work_stealing = options->work_stealing;
+            p->dequeue_batch = options->dequeue_batch;
+            if (p->dequeue_batch == 0U) {
+                p->dequeue_batch = 1U;
+            }
+            else if (p->dequeue_batch > CTP_MAX_DEQUEUE_BATCH) {
+                p->dequeue_batch = CTP_MAX_DEQUEUE_BATCH;
+            }
+            p->unbounded = (options->unbounded != 0)
+                           && (options->lock_free == 0)
+                           && (options->work_stealing == 0);
+            p->free_segments = NULL;
+            p->free_count = 0U;
+            p->segments = 0U;
+            p->max_segments = NON_PAUSED_VALUE;
+            if ((options->queue_memory_cap / sizeof(struct segment_t))
+                < (size_t)NON_PAUSED_VALUE)
+            {
+                p->max_segments = (pu)((options->queue_memory_cap
+                                        / sizeof(struct segment_t))
+                                       + (((options->queue_memory_cap
+                                            % sizeof(struct segment_t)) != 0U)
+                                          ? 1U : 0U));
+            }
+            p->space_waiters = 0U;
+            p->min_threads = options->min_threads;
+            p->keep_alive_ms = options->keep_alive_ms;
+            p->spin_count = options->spin_count;
+            p->yield_count = options->yield_count;
+            p->lock_free = (options->lock_free != 0)
+                           || (options->work_stealing != 0);
+
+            if (alloc_lanes(p, options, size) != 0) {
+                level++;
+
+                if (pthread_mutex_init(&p->mutex, NULL) == 0) {
+                    level++;
+
+                    if (sem_init(&p->semaphore, 0, 0U) == 0) {
+                        level++;
+
+                        atomic_init(&p->running, 0U);
+                        atomic_init(&p->slots, 0U);
+                        atomic_init(&p->spawning, 0U);
+                        atomic_init(&p->waiting, 0U);
+                        p->queue_count = 0U;
+                        p->old_count = NON_PAUSED_VALUE;
+                        atomic_init(&p->prio_tick, 0U);
+                        p->block = options->block;
+                        p->caller_runs = options->caller_runs;
+                        p->thread_start = options->thread_start;
+                        p->thread_exit = options->thread_exit;
+                        p->hook_argument = options->hook_argument;
+                        p->high_watermark = (options->watermark != NULL) ?
+                            options->high_watermark : 0U;
+                        p->low_watermark = options->low_watermark;
+                        if ((p->high_watermark > 0U)
+                            && (p->low_watermark >= p->high_watermark))
+                        {
+                            p->low_watermark = p->high_watermark - 1U;
+                        }
+                        p->watermark = options->watermark;
+                        p->watermark_argument = options->watermark_argument;
+                        atomic_init(&p->above, 0);
+                        p->notify = options->completions;
+                        p->io = NULL;
+                        atomic_init(&p->blocking, 0U);
+                        atomic_init(&p->helpers, 0U);
+                        atomic_init(&p->done, 0);
+                        atomic_init(&p->paused, 0);
+                        atomic_init(&p->pending, 0U);
+                        atomic_init(&p->idle_waiters, 0U);
+                        atomic_init(&p->wakeups_avoided, 0U);
+                        init_timers(p);
+#ifdef CTP_STATS
+                        stats_init(&p->stats);
+#endif
+
+                        level += init_signals(p);
+                    }
+                }
+            }
+            else if (p->lanes != NULL) {
+                level++;
+            }
+        }
+    }
+
+    if ((level > 0) && (level < POOL_READY)) {
+        free_resources(p, level);
+        p = NULL;
+    }
+    else if ((p != NULL) && (options->eager != 0)) {
+        pu i;
+        for (i = 0U; i < p->threads_num; i++) {
+            spawn_thread(p);
+        }
+    }
+
+    if ((p != NULL) && (options->blocking_threads > 0U)) {
+        ctp_options_t io;
+
+        ctp_options_init(&io);
+        io.threads_num = options->blocking_threads;
+        io.unbounded = -1;
+        io.keep_alive_ms = (options->keep_alive_ms > 0U) ?
+            options->keep_alive_ms : CTP_BLOCKING_KEEP_ALIVE;
+
+        p->io = ctp_init_ex(&io);
+        if (p->io == NULL) {
+            ctp_finish(p, NULL);
+            p = NULL;
+        }
+    }
+
+    return p;
+}
+
+static int wait_room(sem_t* sem, const struct timespec* deadline)
+{
+    int error;
+
+    do {
+        error = (deadline != NULL) ? sem_timedwait(sem, deadline)
+                                   : sem_wait(sem);
+    } while ((error != 0) && (errno == EINTR));
+
+    return error;
+}
+
+static int add_last(struct pool_t* p, struct lane_t* lane,
+                    const struct timespec* deadline)
+{
+    const int waits = ((p->block != 0) || (deadline != NULL))
+                      && (p->old_count == NON_PAUSED_VALUE);
+    const unsigned long long since = stats_clock();
+    int ok = waits;
+    int error = 0;
+
+    if ((ok != 0) && (p->unbounded != 0)) {
+        do {
+            p->space_waiters++;
+            error = (deadline != NULL) ?
+                pthread_cond_timedwait(&p->space_cond, &p->mutex, deadline)
+                : pthread_cond_wait(&p->space_cond, &p->mutex);
+            p->space_waiters--;
+            ok = grow_lane(p, lane);
+        } while ((ok == 0) && (error == 0));
+    }
+    else if (ok != 0) {
+        int owned = 0;
+
+        do {
+            pthread_mutex_unlock(&p->mutex);
+
+            error = wait_room(&lane->sem_add, deadline);
+
+            pthread_mutex_lock(&p->mutex);
+
+            if (error != 0) {
+                ok = 0;
+            }
+            else if (lane->count == lane->size) {
+                sem_post(&lane->sem_add);
+            }
+            else {
+                owned--;
+            }
+
+        } while ((owned == 0) && (ok != 0));
+    }
+
+    if (waits != 0) {
+        stats_block(p, since);
+    }
+
+    return ok;
+}
+
+static void notify_locked(struct pool_t* p, pu n, struct local_t** spawn)
+{
+    struct local_t* local = NULL;
+    pu i = 0U;
+
+    while ((i < n) && (i < p->waiting)
+           && (p->old_count == NON_PAUSED_VALUE))
+    {
+        sem_post(&p->semaphore);
+        i++;
+    }
+    while ((i < n) && (p->old_count == NON_PAUSED_VALUE)
+           && ((local = reserve_thread(p)) != NULL))
+    {
+        local->next = *spawn;
+        *spawn = local;
+        i++;
+    }
+}
+
+static int run_caller(struct pool_t* p, struct lane_t* lane,
+                      const ctp_work_t* work, const struct worker_t* model,
+                      unsigned long long stamp)
+{
+    struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+    int room = 0;
+
+    while ((room == 0) && (p->old_count == NON_PAUSED_VALUE)
+           && (p->queue_count > 0U))
+    {
+        const pu n = pop_locked(p, works);
+
+        pthread_mutex_unlock(&p->mutex);
+        run_works(p, NULL, works, n);
+        pthread_mutex_lock(&p->mutex);
+
+        room = lane_room(p, lane);
+    }
+
+    if ((room == 0) && (p->old_count == NON_PAUSED_VALUE)) {
+        set_slot(works, work, model);
+        stats_stamp(works, stamp);
+
+        pthread_mutex_unlock(&p->mutex);
+        run_works(p, NULL, works, 1U);
+        pthread_mutex_lock(&p->mutex);
+
+        room = -1;
+    }
+
+    return room;
+}
+
+static pu add_locked(struct pool_t* p, struct lane_t* lane,
+                     const ctp_work_t* works, pu count,
+                     const struct worker_t* model,
+                     const struct timespec* deadline)
+{
+    const unsigned long long stamp = stats_clock();
+    struct local_t* spawn = NULL;
+    pu added = 0U;
+    pu notified = 0U;
+    int full = 0;
+
+    pthread_mutex_lock(&p->mutex);
+
+    p->pending += count;
+
+    if ((p->done == 0) && (p->running == 0U) && (is_paused(p) == 0)) {
+        spawn = reserve_thread(p);
+        if (spawn != NULL) {
+            pthread_mutex_unlock(&p->mutex);
+            start_threads(p, spawn);
+            spawn = NULL;
+            pthread_mutex_lock(&p->mutex);
+        }
+    }
+
+    if ((p->done == 0) && ((p->running > 0U) || (is_paused(p) != 0))) {
+        while ((added < count) && (full == 0)) {
+            int room = lane_room(p, lane);
+
+            if (room == 0) {
+                notify_locked(p, added - notified, &spawn);
+                notified = added;
+                if (spawn != NULL) {
+                    pthread_mutex_unlock(&p->mutex);
+                    start_threads(p, spawn);
+                    spawn = NULL;
+                    pthread_mutex_lock(&p->mutex);
+                }
+                if ((p->caller_runs != 0) && (deadline == NULL)) {
+                    room = run_caller(p, lane, &works[added], model, stamp);
+                }
+                else {
+                    room = (add_last(p, lane, deadline) != 0) ? 1 : 0;
+                }
+                full = (room == 0);
+            }
+
+            if (room > 0) {
+                push_locked(p, lane, &works[added], model, stamp);
+            }
+            if (full == 0) {
+                added++;
+            }
+        }
+
+        notify_locked(p, added - notified, &spawn);
+    }
+
+    work_done(p, count - added);
+    stats_submit(p, added, count);
+
+    pthread_mutex_unlock(&p->mutex);
+
+    start_threads(p, spawn);
+    check_watermark(p);
+
+    return added;
+}
+
+static void notify_lock_free(struct pool_t* p, pu n)
+{
+    pu i = 0U;
+
+    while ((i < n) && (atomic_load(&p->paused) == 0)
+           && (wake_worker(p) != 0))
+    {
+        i++;
+    }
+    while ((i < n) && (atomic_load(&p->paused) == 0)
+           && (p->running < p->threads_num))
+    {
+        spawn_thread(p);
+        i++;
+    }
+}
+
+static int run_caller_lock_free(struct pool_t* p, struct local_t* local,
+                                struct lane_t* lane, struct worker_t* work)
+{
+    struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+    pu n = 1U;
+    int pushed = 0;
+
+    while ((pushed == 0) && (n > 0U)) {
+        n = take_work(p, local, works);
+        run_works(p, local, works, n);
+        pushed = lfq_push(&lane->lfq, work);
+    }
+
+    if ((pushed == 0) && (atomic_load(&p->paused) == 0)) {
+        run_works(p, local, work, 1U);
+        pushed = -1;
+    }
+
+    return pushed;
+}
+
+static pu add_lock_free(struct pool_t* p, struct lane_t* lane,
+                        const ctp_work_t* works, pu count,
+                        const struct worker_t* model,
+                        const struct timespec* deadline)
+{
+    struct local_t* const local = (lane == p->lanes) ? get_local(p) : NULL;
+    const unsigned long long stamp = stats_clock();
+    pu added = 0U;
+    pu notified = 0U;
+
+    p->pending += count;
+
+    if ((p->running > 0U) || (atomic_load(&p->paused) != 0)
+        || (spawn_thread(p) != 0))
+    {
+        int full = 0;
+
+        while ((added < count) && (full == 0)) {
+            struct worker_t w;
+            int pushed;
+
+            set_slot(&w, &works[added], model);
+            stats_stamp(&w, stamp);
+
+            pushed = (local != NULL) && (deque_push(&local->deque, &w) != 0);
+            if (pushed == 0) {
+                pushed = lfq_push(&lane->lfq, &w);
+            }
+
+            if ((pushed == 0) && (p->caller_runs != 0) && (deadline == NULL)
+                && (atomic_load(&p->paused) == 0))
+            {
+                notify_lock_free(p, added - notified);
+                notified = added;
+                pushed = run_caller_lock_free(p, local, lane, &w);
+            }
+            else if ((pushed == 0) && ((p->block != 0) || (deadline != NULL))
+                     && (atomic_load(&p->paused) == 0))
+            {
+                notify_lock_free(p, added - notified);
+                notified = added;
+
+                lane->blocked++;
+                atomic_thread_fence(memory_order_seq_cst);
+
+                pushed = lfq_push(&lane->lfq, &w);
+                if ((pushed == 0) || (claim(&lane->blocked) == 0)) {
+                    const unsigned long long since = stats_clock();
+
+                    if ((pushed != 0) || (deadline == NULL)) {
+                        wait_room(&lane->sem_add, NULL);
+                    }
+                    else if (wait_room(&lane->sem_add, deadline) != 0) {
+                        if (claim(&lane->blocked) != 0) {
+                            full = -1;
+                        }
+                        else {
+                            wait_room(&lane->sem_add, NULL);
+                        }
+                    }
+                    stats_block(p, since);
+                }
+            }
+            else if (pushed == 0) {
+                full = -1;
+            }
+
+            if (pushed != 0) {
+                added++;
+            }
+        }
+
+        notify_lock_free(p, added - notified);
+    }
+
+    work_done(p, count - added);
+    stats_submit(p, added, count);
+    check_watermark(p);
+
+    return added;
+}
+
+int ctp_add_work(ctpool_t pool, pool_worker_t func, void* argument)
+{
+    ctp_work_t work;
+
+    work.func = func;
+    work.argument = argument;
+
+    return (ctp_add_works(pool, &work, 1U) > 0U) ? -1 : 0;
+}
+
+int ctp_add_work_timed(ctpool_t pool, pool_worker_t func, void* argument,
+                       unsigned int timeout_us)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct timespec deadline;
+    ctp_work_t work;
+    pu added;
+
+    work.func = func;
+    work.argument = argument;
+    get_deadline_us(&deadline, timeout_us);
+
+    added = (p->lock_free != 0) ?
+        add_lock_free(p, p->lanes, &work, 1U, NULL, &deadline)
+        : add_locked(p, p->lanes, &work, 1U, NULL, &deadline);
+
+    return (added > 0U) ? -1 : 0;
+}
+
+int ctp_add_work_prio(ctpool_t pool, unsigned int priority,
+                      pool_worker_t func, void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    ctp_work_t work;
+    pu added = 0U;
+
+    work.func = func;
+    work.argument = argument;
+
+    if (priority < p->lanes_num) {
+        struct lane_t* const lane = &p->lanes[priority];
+        added = (p->lock_free != 0) ?
+            add_lock_free(p, lane, &work, 1U, NULL, NULL)
+            : add_locked(p, lane, &work, 1U, NULL, NULL);
+    }
+
+    return (added > 0U) ? -1 : 0;
+}
+
+int ctp_add_work_tagged(ctpool_t pool, const void* tag, pool_worker_t func,
+                        void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct worker_t model;
+    ctp_work_t work;
+    pu added;
+
+    work.func = func;
+    work.argument = argument;
+    model.func = func;
+    model.tag = tag;
+    model.payload = PAYLOAD_NONE;
+    model.ex = 0;
+
+    added = (p->lock_free != 0) ?
+        add_lock_free(p, p->lanes, &work, 1U, &model, NULL)
+        : add_locked(p, p->lanes, &work, 1U, &model, NULL);
+
+    return (added > 0U) ? -1 : 0;
+}
+
+int ctp_add_work_ex(ctpool_t pool, ctp_worker_ex_t func, void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct worker_t model;
+    ctp_work_t work;
+    pu added;
+
+    work.func = NULL;
+    work.argument = argument;
+    model.func_ex = func;
+    model.tag = NULL;
+    model.payload = PAYLOAD_NONE;
+    model.ex = -1;
+
+    added = (p->lock_free != 0) ?
+        add_lock_free(p, p->lanes, &work, 1U, &model, NULL)
+        : add_locked(p, p->lanes, &work, 1U, &model, NULL);
+
+    return (added > 0U) ? -1 : 0;
+}
+
+int ctp_add_work_payload(ctpool_t pool, pool_worker_t func,
+                         const void* payload, size_t size)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct worker_t model;
+    ctp_work_t work;
+    pu added = 0U;
+
+    model.func = func;
+    model.argument = NULL;
+    model.tag = NULL;
+    model.payload = PAYLOAD_NONE;
+    model.ex = 0;
+
+#if (CTP_INLINE_PAYLOAD > 0)
+    if (size <= CTP_INLINE_PAYLOAD) {
+        if (size > 0U) {
+            memcpy(&model.data, payload, size);
+        }
+        model.payload = PAYLOAD_INLINE;
+    }
+    else
+#endif
+    if (size <= CTP_MAX_PAYLOAD) {
+        pu k = 0U;
+
+        while ((PAYLOAD_MIN << k) < size) {
+            k++;
+        }
+        model.argument = slab_alloc(&p->payloads[k]);
+        if (model.argument != NULL) {
+            if (size > 0U) {
+                memcpy(model.argument, payload, size);
+            }
+            model.payload = PAYLOAD_SLAB + k;
+        }
+    }
+
+    if (model.payload != PAYLOAD_NONE) {
+        work.func = func;
+        work.argument = model.argument;
+
+        added = (p->lock_free != 0) ?
+            add_lock_free(p, p->lanes, &work, 1U, &model, NULL)
+            : add_locked(p, p->lanes, &work, 1U, &model, NULL);
+
+        if (added == 0U) {
+            release_payload(p, &model);
+        }
+    }
+
+    return (added > 0U) ? -1 : 0;
+}
+
+unsigned int ctp_add_works(ctpool_t pool, const ctp_work_t* works,
+                           unsigned int count)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    return (p->lock_free != 0) ?
+        add_lock_free(p, p->lanes, works, count, NULL, NULL)
+        : add_locked(p, p->lanes, works, count, NULL, NULL);
+}
+
+static void* run_future(void* arg)
+{
+    struct ctp_future* const f = (struct ctp_future*)arg;
+    struct pool_t* const p = f->pool;
+    int state;
+
+    f->result = f->func(f->argument);
+
+    state = atomic_fetch_or(&f->state, FUTURE_DONE);
+    if ((state & FUTURE_RELEASED) != 0) {
+        slab_free(&p->futures, f);
+    }
+    else if ((state & FUTURE_WAITED) != 0) {
+        pthread_mutex_lock(&p->signal_mutex);
+        pthread_cond_broadcast(&p->signal_cond);
+        pthread_mutex_unlock(&p->signal_mutex);
+    }
+
+    return NULL;
+}
+
+ctp_future_t ctp_add_work_future(ctpool_t pool, pool_worker_t func,
+                                 void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct ctp_future* f = (struct ctp_future*)slab_alloc(&p->futures);
+
+    if (f != NULL) {
+        f->pool = p;
+        f->func = func;
+        f->argument = argument;
+        f->result = NULL;
+        atomic_init(&f->state, 0);
+
+        if (ctp_add_work(pool, run_future, f) == 0) {
+            slab_free(&p->futures, f);
+            f = NULL;
+        }
+    }
+
+    return f;
+}
+
+int ctp_future_poll(ctp_future_t future, void** result)
+{
+    return ctp_future_wait(future, 0U, result);
+}
+
+int ctp_future_wait(ctp_future_t future, unsigned int timeout_ms,
+                    void** result)
+{
+    struct ctp_future* const f = (struct ctp_future*)future;
+    int done = ((atomic_load(&f->state) & FUTURE_DONE) != 0);
+
+    if ((done == 0) && (timeout_ms > 0U)) {
+        struct pool_t* const p = f->pool;
+        struct timespec ts;
+        int error = 0;
+
+        get_deadline(&ts, timeout_ms);
+
+        pthread_mutex_lock(&p->signal_mutex);
+
+        done = ((atomic_fetch_or(&f->state, FUTURE_WAITED) & FUTURE_DONE) != 0);
+        while ((done == 0) && (error == 0)) {
+            error = (timeout_ms == CTP_INFINITE) ?
+                pthread_cond_wait(&p->signal_cond, &p->signal_mutex) :
+                pthread_cond_timedwait(&p->signal_cond, &p->signal_mutex, &ts);
+            done = ((atomic_load(&f->state) & FUTURE_DONE) != 0);
+        }
+
+        pthread_mutex_unlock(&p->signal_mutex);
+    }
+
+    if ((done != 0) && (result != NULL)) {
+        *result = f->result;
+    }
+
+    return done;
+}
+
+void ctp_future_release(ctp_future_t future)
+{
+    struct ctp_future* const f = (struct ctp_future*)future;
+
+    if ((atomic_fetch_or(&f->state, FUTURE_RELEASED) & FUTURE_DONE) != 0) {
+        slab_free(&f->pool->futures, f);
+    }
+}
+
+#ifdef CTP_HAS_NOTIFY_FD
+static void signal_completion(struct pool_t* p)
+{
+#ifdef CTP_HAS_EVENTFD
+    const unsigned long long one = 1U;
+#else
+    const char one = 1;
+#endif
+    ssize_t written;
+
+    do {
+        written = write(p->notify_fd[1], &one, sizeof(one));
+    } while ((written < 0) && (errno == EINTR));
+
+    if ((written < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        atomic_store(&p->completion_armed, 1);
+    }
+}
+#endif
+
+static void* run_completion(void* arg)
+{
+    struct completion_t* const c = (struct completion_t*)arg;
+    struct pool_t* const p = c->pool;
+    struct completion_t* prev;
+
+    c->result = c->func(c->argument);
+
+    atomic_store_explicit(&c->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&p->completion_tail, c,
+                                    memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, c, memory_order_release);
+
+#ifdef CTP_HAS_NOTIFY_FD
+    if (atomic_exchange(&p->completion_armed, 0) != 0) {
+        signal_completion(p);
+    }
+#endif
+
+    return NULL;
+}
+
+int ctp_add_work_notify(ctpool_t pool, pool_worker_t func, void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct completion_t* c = NULL;
+    int added = 0;
+
+    if (p->notify != 0) {
+        c = (struct completion_t*)slab_alloc(&p->completions);
+    }
+
+    if (c != NULL) {
+        c->pool = p;
+        c->func = func;
+        c->argument = argument;
+
+        added = ctp_add_work(pool, run_completion, c);
+        if (added == 0) {
+            slab_free(&p->completions, c);
+        }
+    }
+
+    return added;
+}
+
+int ctp_get_completion_fd(const ctpool_t pool)
+{
+    const struct pool_t* const p = (const struct pool_t*)pool;
+    return p->notify_fd[0];
+}
+
+static pu pop_completions(struct pool_t* p, ctp_completion_t* completions,
+                          pu max)
+{
+    pu n = 0U;
+    struct completion_t* next = (max > 0U) ?
+        atomic_load_explicit(&p->completion_head->next, memory_order_acquire)
+        : NULL;
+
+    while (next != NULL) {
+        completions[n].argument = next->argument;
+        completions[n].result = next->result;
+        n++;
+
+        slab_free(&p->completions, p->completion_head);
+        p->completion_head = next;
+
+        next = (n < max) ?
+            atomic_load_explicit(&next->next, memory_order_acquire) : NULL;
+    }
+
+    return n;
+}
+
+unsigned int ctp_drain_completions(ctpool_t pool, ctp_completion_t* completions,
+                                   unsigned int max)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    pu n = 0U;
+
+    if (p->notify != 0) {
+        n = pop_completions(p, completions, max);
+
+        if (n < max) {
+#ifdef CTP_HAS_NOTIFY_FD
+#ifdef CTP_HAS_EVENTFD
+            unsigned long long count;
+            ssize_t got;
+
+            do {
+                got = read(p->notify_fd[0], &count, sizeof(count));
+            } while ((got < 0) && (errno == EINTR));
+#else
+            char drained[64];
+            ssize_t got;
+
+            do {
+                got = read(p->notify_fd[0], drained, sizeof(drained));
+            } while ((got > 0) || ((got < 0) && (errno == EINTR)));
+#endif
+#endif
+            atomic_store(&p->completion_armed, 1);
+            n += pop_completions(p, &completions[n], max - n);
+        }
+    }
+
+    return n;
+}
+
+static int grow_timers(struct pool_t* p)
+{
+    const pu size = (p->timers_size > 0U) ? (p->timers_size * 2U) : 64U;
+    struct timer_node_t* timers = NULL;
+    int ok = 0;
+
+    if ((size > p->timers_size) && (size < TIMER_NONE)) {
+        timers = (struct timer_node_t*)
+            realloc(p->timers, sizeof(struct timer_node_t) * (size_t)size);
+    }
+
+    if (timers != NULL) {
+        pu i = size;
+
+        while (i > p->timers_size) {
+            i--;
+            timers[i].generation = 0U;
+            timers[i].list = TIMER_NONE;
+            timers[i].next = p->timer_free;
+            p->timer_free = i;
+        }
+        p->timers = timers;
+        p->timers_size = size;
+        ok = -1;
+    }
+
+    return ok;
+}
+
+static ctp_timer_t add_timer(struct pool_t* p, unsigned long long due,
+                             pu period, pool_worker_t func, void* argument)
+{
+    ctp_timer_t timer = 0U;
+    int notify = 0;
+
+    pthread_mutex_lock(&p->timer_mutex);
+
+    if ((p->done == 0)
+        && ((p->timer_free != TIMER_NONE) || (grow_timers(p) != 0)))
+    {
+        const pu index = p->timer_free;
+        struct timer_node_t* const t = &p->timers[index];
+        const unsigned long long last = atomic_load(&p->timer_next);
+        unsigned long long next;
+
+        p->timer_free = t->next;
+        t->due = due;
+        t->period = period;
+        t->func = func;
+        t->argument = argument;
+
+        timer_advance(p, now_ms());
+        timer_place(p, index);
+        p->timers_num++;
+
+        next = timer_next_event(p);
+        atomic_store(&p->timer_next, next);
+        notify = (next < last) && (next < p->timer_sleep);
+
+        timer = ((ctp_timer_t)t->generation << 32U) | (ctp_timer_t)(index + 1U);
+    }
+
+    pthread_mutex_unlock(&p->timer_mutex);
+
+    if ((notify != 0) && (p->lock_free != 0)) {
+        notify_lock_free(p, 1U);
+    }
+    else if (notify != 0) {
+        struct local_t* spawn = NULL;
+
+        pthread_mutex_lock(&p->mutex);
+        notify_locked(p, 1U, &spawn);
+        pthread_mutex_unlock(&p->mutex);
+
+        start_threads(p, spawn);
+    }
+
+    return timer;
+}
+
+ctp_timer_t ctp_add_work_at(ctpool_t pool, const struct timespec* when,
+                            pool_worker_t func, void* argument)
+{
+    const unsigned long long due = ((unsigned long long)when->tv_sec * 1000U)
+                                   + (((unsigned long long)when->tv_nsec
+                                       + 999999U) / 1000000U);
+    return add_timer((struct pool_t*)pool, due, 0U, func, argument);
+}
+
+ctp_timer_t ctp_add_work_after(ctpool_t pool, unsigned int delay_ms,
+                               pool_worker_t func, void* argument)
+{
+    return add_timer((struct pool_t*)pool, now_ms() + delay_ms, 0U, func,
+                     argument);
+}
+
+ctp_timer_t ctp_add_work_every(ctpool_t pool, unsigned int period_ms,
+                               pool_worker_t func, void* argument)
+{
+    ctp_timer_t timer = 0U;
+
+    if (period_ms > 0U) {
+        timer = add_timer((struct pool_t*)pool, now_ms() + period_ms,
+                          period_ms, func, argument);
+    }
+
+    return timer;
+}
+
+int ctp_timer_cancel(ctpool_t pool, ctp_timer_t timer)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    const pu index = (pu)(timer & 0xFFFFFFFFU) - 1U;
+    const pu generation = (pu)(timer >> 32U);
+    int cancelled = 0;
+
+    pthread_mutex_lock(&p->timer_mutex);
+
+    if ((index < p->timers_size) && (p->timers[index].list != TIMER_NONE)
+        && (p->timers[index].generation == generation))
+    {
+        timer_unlink(p, index);
+        timer_free(p, index);
+        atomic_store(&p->timer_next, timer_next_event(p));
+        cancelled = -1;
+    }
+
+    pthread_mutex_unlock(&p->timer_mutex);
+
+    return cancelled;
+}
+
+static int deadline_passed(const struct timespec* ts)
+{
+    struct timespec now;
+
+    timespec_get(&now, TIME_UTC);
+
+    return (now.tv_sec > ts->tv_sec)
+           || ((now.tv_sec == ts->tv_sec) && (now.tv_nsec >= ts->tv_nsec));
+}
+
+static pu help_work(struct pool_t* p, struct worker_t* works)
+{
+    pu n = 0U;
+
+    if (p->lock_free != 0) {
+        n = take_work(p, get_local(p), works);
+    }
+    else {
+        pthread_mutex_lock(&p->mutex);
+        if (p->queue_count > 0U) {
+            n = pop_locked(p, works);
+        }
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    return n;
+}
+
+static int wait_pool_idle(struct pool_t* p, unsigned int timeout_ms)
+{
+    if ((p->pending > 0U) && (timeout_ms > 0U)) {
+        struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+        struct timespec ts;
+        int error = 0;
+        pu n;
+
+        get_deadline(&ts, timeout_ms);
+
+        do {
+            n = help_work(p, works);
+            run_works(p, NULL, works, n);
+            if ((timeout_ms != CTP_INFINITE) && (deadline_passed(&ts) != 0)) {
+                error = -1;
+            }
+        } while ((n > 0U) && (error == 0));
+
+        pthread_mutex_lock(&p->signal_mutex);
+        p->idle_waiters++;
+
+        while ((p->pending > 0U) && (error == 0)) {
+            error = (timeout_ms == CTP_INFINITE) ?
+                pthread_cond_wait(&p->signal_cond, &p->signal_mutex) :
+                pthread_cond_timedwait(&p->signal_cond, &p->signal_mutex, &ts);
+        }
+
+        p->idle_waiters--;
+        pthread_mutex_unlock(&p->signal_mutex);
+    }
+
+    return p->pending == 0U;
+}
+
+int ctp_wait_idle(ctpool_t pool, unsigned int timeout_ms)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct pool_t* const io = (struct pool_t*)p->io;
+    int idle = wait_pool_idle(p, timeout_ms);
+
+    while ((idle != 0) && (io != NULL)
+           && ((io->pending > 0U) || (p->pending > 0U)))
+    {
+        idle = (wait_pool_idle(io, timeout_ms) != 0)
+               && (wait_pool_idle(p, timeout_ms) != 0);
+    }
+
+    return idle;
+}
+
+int ctp_add_work_blocking(ctpool_t pool, pool_worker_t func, void* argument)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    return ctp_add_work((p->io != NULL) ? p->io : pool, func, argument);
+}
+
+static int helper_retire(struct pool_t* p)
+{
+    pu helpers = atomic_load(&p->helpers);
+    int retired = 0;
+
+    while ((retired == 0)
+           && ((p->done != 0) || (helpers > atomic_load(&p->blocking))))
+    {
+        retired = atomic_compare_exchange_weak(&p->helpers, &helpers,
+                                               helpers - 1U);
+    }
+
+    if ((retired != 0) && (helpers == 1U) && (p->done != 0)) {
+        broadcast_signal(p);
+    }
+
+    return retired;
+}
+
+static void helper_park(struct pool_t* p)
+{
+    struct timespec ts;
+    int error;
+
+    get_deadline(&ts, HELPER_PARK_MS);
+
+    if (p->lock_free != 0) {
+        p->waiting++;
+        atomic_thread_fence(memory_order_seq_cst);
+        error = ((p->done != 0) || (has_work(p) != 0)) ? -1
+                : sem_timedwait(&p->semaphore, &ts);
+        if ((error != 0) && (claim(&p->waiting) == 0)) {
+            sem_wait(&p->semaphore);
+        }
+    }
+    else {
+        pthread_mutex_lock(&p->mutex);
+        error = (p->done != 0) || (p->queue_count > 0U);
+        if (error == 0) {
+            p->waiting++;
+            pthread_mutex_unlock(&p->mutex);
+            sem_timedwait(&p->semaphore, &ts);
+            pthread_mutex_lock(&p->mutex);
+            p->waiting--;
+        }
+        pthread_mutex_unlock(&p->mutex);
+    }
+}
+
+static void* run_helper(void* arg)
+{
+    struct pool_t* const p = (struct pool_t*)arg;
+    struct worker_t works[CTP_MAX_DEQUEUE_BATCH];
+
+    while (helper_retire(p) == 0) {
+        const pu n = help_work(p, works);
+
+        if (n > 0U) {
+            run_works(p, NULL, works, n);
+        }
+        else {
+            helper_park(p);
+        }
+    }
+
+    return NULL;
+}
+
+void ctp_blocking_begin(ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    const pu blocking = atomic_fetch_add(&p->blocking, 1U) + 1U;
+
+    if ((p->io != NULL) && (atomic_load(&p->helpers) < blocking)) {
+        atomic_fetch_add(&p->helpers, 1U);
+        if (ctp_add_work(p->io, run_helper, p) == 0) {
+            count_down(p, &p->helpers);
+        }
+    }
+}
+
+void ctp_blocking_end(ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    atomic_fetch_sub(&p->blocking, 1U);
+}
+
+static int claim_range(struct range_t* r, size_t* first, size_t* last)
+{
+    size_t next = atomic_load_explicit(&r->next, memory_order_relaxed);
+    int claimed = 0;
+
+    while ((claimed == 0) && (next < r->end)) {
+        const size_t left = r->end - next;
+        size_t chunk = left / ((size_t)r->parts * 2U);
+
+        if (chunk < r->grain) {
+            chunk = (left < r->grain) ? left : r->grain;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&r->next, &next,
+                                                  next + chunk,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        {
+            *first = next;
+            *last = next + chunk;
+            claimed = -1;
+        }
+    }
+
+    return claimed;
+}
+
+static void run_range(struct range_t* r)
+{
+    const pu slot = atomic_fetch_add(&r->slots, 1U);
+    void* const acc = (r->accumulators != NULL) ?
+        (void*)&r->accumulators[(size_t)slot * r->stride] : NULL;
+    size_t first;
+    size_t last;
+
+    while (claim_range(r, &first, &last) != 0) {
+        if (r->reduce != NULL) {
+            r->reduce(first, last, acc, r->context);
+        }
+        else {
+            r->func(first, last, r->context);
+        }
+
+        if ((atomic_fetch_add_explicit(&r->completed, last - first,
+                                       memory_order_acq_rel)
+             + (last - first)) == r->total)
+        {
+            sem_post(&r->done);
+        }
+    }
+}
+
+static void release_range(struct range_t* r)
+{
+    if (atomic_fetch_sub(&r->refs, 1U) == 1U) {
+        sem_destroy(&r->done);
+        free(r->accumulators);
+        free(r);
+    }
+}
+
+static void* range_worker(void* arg)
+{
+    struct range_t* const r = (struct range_t*)arg;
+    run_range(r);
+    release_range(r);
+    return NULL;
+}
+
+static int parallel_range(struct pool_t* p, struct range_t* r,
+                          void* result, size_t size)
+{
+    const size_t chunks = ((r->total - 1U) / r->grain) + 1U;
+    int ok = -1;
+    pu i;
+
+    r->parts = ((size_t)p->threads_num < chunks) ?
+        (p->threads_num + 1U) : (pu)chunks;
+    r->accumulators = NULL;
+    r->stride = 0U;
+
+    if (r->reduce != NULL) {
+        r->stride = ((size + (2U * CTP_CACHE_LINE) - 1U) / CTP_CACHE_LINE)
+                    * CTP_CACHE_LINE;
+        r->accumulators = (char*)malloc(r->stride * (size_t)r->parts);
+        if (r->accumulators != NULL) {
+            for (i = 0U; i < r->parts; i++) {
+                memcpy(&r->accumulators[(size_t)i * r->stride], result, size);
+            }
+        }
+        else {
+            ok = 0;
+        }
+    }
+
+    if ((ok != 0) && (sem_init(&r->done, 0, 0U) == 0)) {
+        atomic_init(&r->refs, r->parts);
+        for (i = 1U; i < r->parts; i++) {
+            if ((is_paused(p) != 0)
+                || (ctp_add_work_tagged(p, &range_tag, range_worker, r) == 0))
+            {
+                atomic_fetch_sub(&r->refs, 1U);
+            }
+        }
+
+        run_range(r);
+        sem_wait(&r->done);
+
+        if (r->reduce != NULL) {
+            const pu used = atomic_load(&r->slots);
+            for (i = 0U; (i < used) && (i < r->parts); i++) {
+                r->combine(result, &r->accumulators[(size_t)i * r->stride],
+                           r->context);
+            }
+        }
+
+        release_range(r);
+    }
+    else {
+        free(r->accumulators);
+        free(r);
+        ok = 0;
+    }
+
+    return ok;
+}
+
+static struct range_t* new_range(size_t begin, size_t end, size_t grain,
+                                 void* context)
+{
+    struct range_t* const r = (struct range_t*)malloc(sizeof(struct range_t));
+
+    if (r != NULL) {
+        atomic_init(&r->next, begin);
+        atomic_init(&r->completed, 0U);
+        atomic_init(&r->slots, 0U);
+        r->end = end;
+        r->total = end - begin;
+        r->grain = (grain > 0U) ? grain : 1U;
+        r->func = NULL;
+        r->reduce = NULL;
+        r->combine = NULL;
+        r->context = context;
+    }
+
+    return r;
+}
+
+int ctp_parallel_for(ctpool_t pool, size_t begin, size_t end, size_t grain,
+                     ctp_range_worker_t func, void* context)
+{
+    int ok = -1;
+
+    if (begin < end) {
+        struct range_t* const r = new_range(begin, end, grain, context);
+
+        if (r != NULL) {
+            r->func = func;
+            ok = parallel_range((struct pool_t*)pool, r, NULL, 0U);
+        }
+        else {
+            ok = 0;
+        }
+    }
+
+    return ok;
+}
+
+int ctp_parallel_reduce(ctpool_t pool, size_t begin, size_t end, size_t grain,
+                        ctp_reduce_worker_t func, ctp_combine_t combine,
+                        void* result, size_t size, void* context)
+{
+    int ok = -1;
+
+    if (begin < end) {
+        struct range_t* const r = new_range(begin, end, grain, context);
+
+        if (r != NULL) {
+            r->reduce = func;
+            r->combine = combine;
+            ok = parallel_range((struct pool_t*)pool, r, result, size);
+        }
+        else {
+            ok = 0;
+        }
+    }
+
+    return ok;
+}
+
+ctp_graph_t ctp_graph_create(void)
+{
+    struct ctp_graph* g = (struct ctp_graph*)malloc(sizeof(struct ctp_graph));
+
+    if (g != NULL) {
+        g->nodes = NULL;
+        g->nodes_num = 0U;
+        g->nodes_size = 0U;
+        g->checked = -1;
+        g->running = 0;
+        g->pool = NULL;
+        atomic_init(&g->left, 0U);
+
+        if (pthread_mutex_init(&g->mutex, NULL) != 0) {
+            free(g);
+            g = NULL;
+        }
+        else if (pthread_cond_init(&g->cond, NULL) != 0) {
+            pthread_mutex_destroy(&g->mutex);
+            free(g);
+            g = NULL;
+        }
+    }
+
+    return g;
+}
+
+static int graph_idle(struct ctp_graph* g)
+{
+    int idle;
+
+    pthread_mutex_lock(&g->mutex);
+    idle = (g->running == 0);
+    pthread_mutex_unlock(&g->mutex);
+
+    return idle;
+}
+
+int ctp_graph_add(ctp_graph_t graph, pool_worker_t func, void* argument,
+                  unsigned int* node)
+{
+    struct ctp_graph* const g = (struct ctp_graph*)graph;
+    int ok = graph_idle(g);
+
+    if ((ok != 0) && (g->nodes_num == g->nodes_size)) {
+        const pu size = (g->nodes_size > 0U) ? (g->nodes_size * 2U) : 16U;
+        struct graph_node_t* const nodes = (struct graph_node_t*)
+            realloc(g->nodes, sizeof(struct graph_node_t) * (size_t)size);
+        pu i;
+
+        if ((size > g->nodes_size) && (nodes != NULL)) {
+            for (i = 0U; i < g->nodes_num; i++) {
+                nodes[i].graph = g;
+            }
+            g->nodes = nodes;
+            g->nodes_size = size;
+        }
+        else {
+            ok = 0;
+        }
+    }
+
+    if (ok != 0) {
+        struct graph_node_t* const n = &g->nodes[g->nodes_num];
+
+        n->graph = g;
+        n->func = func;
+        n->argument = argument;
+        n->next = NULL;
+        n->next_num = 0U;
+        n->next_size = 0U;
+        n->preds = 0U;
+        atomic_init(&n->waiting, 0U);
+        n->link = NULL;
+
+        *node = g->nodes_num;
+        g->nodes_num++;
+    }
+
+    return ok;
+}
+
+int ctp_graph_depend(ctp_graph_t graph, unsigned int node,
+                     unsigned int predecessor)
+{
+    struct ctp_graph* const g = (struct ctp_graph*)graph;
+    int ok = (node < g->nodes_num) && (predecessor < g->nodes_num)
+             && (graph_idle(g) != 0);
+
+    if (ok != 0) {
+        struct graph_node_t* const p = &g->nodes[predecessor];
+
+        if (p->next_num == p->next_size) {
+            const pu size = (p->next_size > 0U) ? (p->next_size * 2U) : 4U;
+            pu* const next = (pu*)realloc(p->next, sizeof(pu) * (size_t)size);
+
+            if ((size > p->next_size) && (next != NULL)) {
+                p->next = next;
+                p->next_size = size;
+            }
+            else {
+                ok = 0;
+            }
+        }
+
+        if (ok != 0) {
+            p->next[p->next_num] = node;
+            p->next_num++;
+            g->nodes[node].preds++;
+            g->checked = 0;
+        }
+    }
+
+    return ok;
+}
+
+static int graph_acyclic(struct ctp_graph* g)
+{
+    struct graph_node_t* stack = NULL;
+    pu seen = 0U;
+    pu i;
+
+    for (i = 0U; i < g->nodes_num; i++) {
+        struct graph_node_t* const n = &g->nodes[i];
+        atomic_store_explicit(&n->waiting, n->preds, memory_order_relaxed);
+        if (n->preds == 0U) {
+            n->link = stack;
+            stack = n;
+        }
+    }
+
+    while (stack != NULL) {
+        struct graph_node_t* const n = stack;
+
+        stack = n->link;
+        seen++;
+        for (i = 0U; i < n->next_num; i++) {
+            struct graph_node_t* const s = &g->nodes[n->next[i]];
+            if (atomic_fetch_sub_explicit(&s->waiting, 1U,
+                                          memory_order_relaxed) == 1U)
+            {
+                s->link = stack;
+                stack = s;
+            }
+        }
+    }
+
+    return seen == g->nodes_num;
+}
+
+static void* run_graph_node(void* arg)
+{
+    struct graph_node_t* list = (struct graph_node_t*)arg;
+
+    while (list != NULL) {
+        struct graph_node_t* const n = list;
+        struct ctp_graph* const g = n->graph;
+        struct graph_node_t* stay = NULL;
+        pu i;
+
+        list = n->link;
+
+        n->func(n->argument);
+
+        for (i = 0U; i < n->next_num; i++) {
+            struct graph_node_t* const s = &g->nodes[n->next[i]];
+
+            if (atomic_fetch_sub(&s->waiting, 1U) == 1U) {
+                if (stay == NULL) {
+                    stay = s;
+                }
+                else {
+                    s->link = NULL;
+                    if (ctp_add_work(g->pool, run_graph_node, s) == 0) {
+                        s->link = list;
+                        list = s;
+                    }
+                }
+            }
+        }
+
+        if (stay != NULL) {
+            stay->link = list;
+            list = stay;
+        }
+
+        if (atomic_fetch_sub(&g->left, 1U) == 1U) {
+            pthread_mutex_lock(&g->mutex);
+            g->running = 0;
+            pthread_cond_broadcast(&g->cond);
+            pthread_mutex_unlock(&g->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+int ctp_graph_run(ctpool_t pool, ctp_graph_t graph)
+{
+    struct ctp_graph* const g = (struct ctp_graph*)graph;
+    int ok;
+
+    pthread_mutex_lock(&g->mutex);
+    ok = (g->running == 0) && ((g->checked != 0) || (graph_acyclic(g) != 0));
+    if ((ok != 0) && (g->nodes_num > 0U)) {
+        g->running = -1;
+    }
+    pthread_mutex_unlock(&g->mutex);
+
+    if ((ok != 0) && (g->nodes_num > 0U)) {
+        struct graph_node_t* list = NULL;
+        pu i;
+
+        g->checked = -1;
+        g->pool = (struct pool_t*)pool;
+        atomic_store(&g->left, g->nodes_num);
+        for (i = 0U; i < g->nodes_num; i++) {
+            struct graph_node_t* const n = &g->nodes[i];
+            atomic_store_explicit(&n->waiting, n->preds, memory_order_relaxed);
+        }
+
+        for (i = 0U; i < g->nodes_num; i++) {
+            struct graph_node_t* const n = &g->nodes[i];
+            if (n->preds == 0U) {
+                n->link = NULL;
+                if (ctp_add_work(pool, run_graph_node, n) == 0) {
+                    n->link = list;
+                    list = n;
+                }
+            }
+        }
+
+        run_graph_node(list);
+    }
+
+    return ok;
+}
+
+int ctp_graph_wait(ctp_graph_t graph, unsigned int timeout_ms)
+{
+    struct ctp_graph* const g = (struct ctp_graph*)graph;
+    struct timespec ts;
+    int error = 0;
+    int done;
+
+    if ((timeout_ms > 0U) && (timeout_ms != CTP_INFINITE)) {
+        get_deadline(&ts, timeout_ms);
+    }
+
+    pthread_mutex_lock(&g->mutex);
+
+    while ((g->running != 0) && (timeout_ms > 0U) && (error == 0)) {
+        error = (timeout_ms == CTP_INFINITE) ?
+            pthread_cond_wait(&g->cond, &g->mutex) :
+            pthread_cond_timedwait(&g->cond, &g->mutex, &ts);
+    }
+    done = (g->running == 0);
+
+    pthread_mutex_unlock(&g->mutex);
+
+    return done;
+}
+
+void ctp_graph_destroy(ctp_graph_t graph)
+{
+    struct ctp_graph* const g = (struct ctp_graph*)graph;
+    pu i;
+
+    for (i = 0U; i < g->nodes_num; i++) {
+        free(g->nodes[i].next);
+    }
+    free(g->nodes);
+    pthread_cond_destroy(&g->cond);
+    pthread_mutex_destroy(&g->mutex);
+    free(g);
+}
+
+ctp_strand_t ctp_strand_create(ctpool_t pool, unsigned int count)
+{
+    struct ctp_strand* s =
+        (struct ctp_strand*)malloc(sizeof(struct ctp_strand));
+
+    if (s != NULL) {
+        pu i = 0U;
+
+        s->pool = (struct pool_t*)pool;
+        s->lanes_num = (count > 0U) ? count : 1U;
+        s->lanes = (struct strand_lane_t*)
+            malloc(sizeof(struct strand_lane_t) * s->lanes_num);
+        atomic_init(&s->busy, 0U);
+
+        while ((s->lanes != NULL) && (i < s->lanes_num)
+               && (pthread_mutex_init(&s->lanes[i].mutex, NULL) == 0))
+        {
+            s->lanes[i].owner = s;
+            s->lanes[i].head = NULL;
+            s->lanes[i].tail = NULL;
+            s->lanes[i].free_nodes = NULL;
+            s->lanes[i].scheduled = 0;
+            i++;
+        }
+
+        if ((i < s->lanes_num) || (pthread_mutex_init(&s->mutex, NULL) != 0)) {
+            while (i > 0U) {
+                i--;
+                pthread_mutex_destroy(&s->lanes[i].mutex);
+            }
+            free(s->lanes);
+            free(s);
+            s = NULL;
+        }
+        else if (pthread_cond_init(&s->cond, NULL) != 0) {
+            for (i = 0U; i < s->lanes_num; i++) {
+                pthread_mutex_destroy(&s->lanes[i].mutex);
+            }
+            pthread_mutex_destroy(&s->mutex);
+            free(s->lanes);
+            free(s);
+            s = NULL;
+        }
+    }
+
+    return s;
+}
+
+static void strand_idle(struct ctp_strand* s)
+{
+    pu busy = atomic_load(&s->busy);
+    int done = 0;
+
+    while ((done == 0) && (busy > 1U)) {
+        done = atomic_compare_exchange_weak(&s->busy, &busy, busy - 1U);
+    }
+
+    if (done == 0) {
+        pthread_mutex_lock(&s->mutex);
+        if (atomic_fetch_sub(&s->busy, 1U) == 1U) {
+            pthread_cond_broadcast(&s->cond);
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+
+static void* run_strand(void* arg)
+{
+    struct strand_lane_t* const lane = (struct strand_lane_t*)arg;
+    pu ran = 0U;
+    int more = -1;
+
+    while (more != 0) {
+        struct strand_node_t* node;
+        pool_worker_t func = NULL;
+        void* argument = NULL;
+
+        pthread_mutex_lock(&lane->mutex);
+        node = lane->head;
+        if (node != NULL) {
+            lane->head = node->next;
+            if (lane->head == NULL) {
+                lane->tail = NULL;
+            }
+            func = node->func;
+            argument = node->argument;
+            node->next = lane->free_nodes;
+            lane->free_nodes = node;
+        }
+        else {
+            lane->scheduled = 0;
+        }
+        pthread_mutex_unlock(&lane->mutex);
+
+        if (node != NULL) {
+            func(argument);
+            ran++;
+            if ((ran == STRAND_BATCH)
+                && (ctp_add_work(lane->owner->pool, run_strand, lane) != 0))
+            {
+                more = 0;
+            }
+            else if (ran == STRAND_BATCH) {
+                ran = 0U;
+            }
+        }
+        else {
+            strand_idle(lane->owner);
+            more = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static int strand_post(struct strand_lane_t* lane, pool_worker_t func,
+                       void* argument)
+{
+    struct strand_node_t* node;
+    int schedule = 0;
+
+    pthread_mutex_lock(&lane->mutex);
+
+    node = lane->free_nodes;
+    if (node != NULL) {
+        lane->free_nodes = node->next;
+    }
+    else {
+        node = (struct strand_node_t*)malloc(sizeof(struct strand_node_t));
+    }
+
+    if (node != NULL) {
+        node->func = func;
+        node->argument = argument;
+        node->next = NULL;
+        if (lane->tail != NULL) {
+            lane->tail->next = node;
+        }
+        else {
+            lane->head = node;
+        }
+        lane->tail = node;
+
+        if (lane->scheduled == 0) {
+            lane->scheduled = -1;
+            schedule = -1;
+            atomic_fetch_add(&lane->owner->busy, 1U);
+        }
+    }
+
+    pthread_mutex_unlock(&lane->mutex);
+
+    if ((schedule != 0)
+        && (ctp_add_work(lane->owner->pool, run_strand, lane) == 0))
+    {
+        run_strand(lane);
+    }
+
+    return node != NULL;
+}
+
+int ctp_strand_post(ctp_strand_t strand, pool_worker_t func, void* argument)
+{
+    struct ctp_strand* const s = (struct ctp_strand*)strand;
+    return strand_post(s->lanes, func, argument);
+}
+
+int ctp_strand_post_key(ctp_strand_t strand, size_t key, pool_worker_t func,
+                        void* argument)
+{
+    struct ctp_strand* const s = (struct ctp_strand*)strand;
+    unsigned long long h = (unsigned long long)key;
+
+    h ^= h >> 33U;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33U;
+
+    return strand_post(&s->lanes[h % s->lanes_num], func, argument);
+}
+
+int ctp_strand_wait(ctp_strand_t strand, unsigned int timeout_ms)
+{
+    struct ctp_strand* const s = (struct ctp_strand*)strand;
+    struct timespec ts;
+    int error = 0;
+    int done;
+
+    if ((timeout_ms > 0U) && (timeout_ms != CTP_INFINITE)) {
+        get_deadline(&ts, timeout_ms);
+    }
+
+    pthread_mutex_lock(&s->mutex);
+
+    while ((atomic_load(&s->busy) > 0U) && (timeout_ms > 0U) && (error == 0)) {
+        error = (timeout_ms == CTP_INFINITE) ?
+            pthread_cond_wait(&s->cond, &s->mutex) :
+            pthread_cond_timedwait(&s->cond, &s->mutex, &ts);
+    }
+    done = (atomic_load(&s->busy) == 0U);
+
+    pthread_mutex_unlock(&s->mutex);
+
+    return done;
+}
+
+void ctp_strand_destroy(ctp_strand_t strand)
+{
+    struct ctp_strand* const s = (struct ctp_strand*)strand;
+    pu i;
+
+    ctp_strand_wait(strand, CTP_INFINITE);
+
+    for (i = 0U; i < s->lanes_num; i++) {
+        while (s->lanes[i].free_nodes != NULL) {
+            struct strand_node_t* const node = s->lanes[i].free_nodes;
+            s->lanes[i].free_nodes = node->next;
+            free(node);
+        }
+        pthread_mutex_destroy(&s->lanes[i].mutex);
+    }
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    free(s->lanes);
+    free(s);
+}
+
+void ctp_pause(ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    pthread_mutex_lock(&p->mutex);
+    if (p->lock_free != 0) {
+        atomic_store(&p->paused, 1);
+    }
+    else if (p->old_count == NON_PAUSED_VALUE) {
+        p->old_count = p->queue_count;
+        p->queue_count = 0U;
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
+
+void ctp_resume(ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    struct local_t* spawn = NULL;
+    pu backlog = 0U;
+
+    pthread_mutex_lock(&p->mutex);
+    if (p->lock_free != 0) {
+        if (atomic_exchange(&p->paused, 0) != 0) {
+            while (wake_worker(p) != 0) {
+            }
+            backlog = p->pending;
+        }
+    }
+    else if (p->old_count != NON_PAUSED_VALUE) {
+        p->queue_count = p->old_count;
+        p->old_count = NON_PAUSED_VALUE;
+
+        notify_locked(p, p->queue_count, &spawn);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    start_threads(p, spawn);
+    notify_lock_free(p, backlog);
+}
+
+static void drop_work(struct pool_t* p, struct worker_t* work)
+{
+    if (work->tag == &range_tag) {
+        release_range((struct range_t*)work->argument);
+    }
+    release_payload(p, work);
+}
+
+static pu cancel_lane(struct pool_t* p, struct lane_t* lane, const void* tag,
+                      int all)
+{
+    const int unbounded = p->unbounded;
+    struct segment_t* segment = lane->first;
+    pu index = lane->head;
+    pu cancelled = 0U;
+    pu i;
+
+    for (i = 0U; i < lane->count; i++) {
+        struct worker_t* const work = (unbounded != 0) ?
+            &segment->works[index] : &lane->queue[index];
+
+        if ((work->func != NULL) && ((all != 0) || (work->tag == tag))) {
+            work->func = NULL;
+            drop_work(p, work);
+            cancelled++;
+        }
+
+        index++;
+        if ((unbounded != 0) && (index == CTP_SEGMENT_SIZE)) {
+            segment = segment->next;
+            index = 0U;
+        }
+        else if ((unbounded == 0) && (index == lane->size)) {
+            index = 0U;
+        }
+    }
+
+    return cancelled;
+}
+
+void ctp_clear_queue(ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    pthread_mutex_lock(&p->mutex);
+    if (p->lock_free != 0) {
+        struct worker_t work;
+        pu cleared = 0U;
+        pu i;
+
+        for (i = 0U; i < p->lanes_num; i++) {
+            while (lfq_pop(&p->lanes[i].lfq, &work) != 0) {
+                wake_producer(&p->lanes[i]);
+                drop_work(p, &work);
+                cleared++;
+            }
+        }
+        for (i = 0U; (p->work_stealing != 0) && (i < p->slots); i++) {
+            while (deque_steal(&p->locals[i]->deque, &work) != 0) {
+                drop_work(p, &work);
+                cleared++;
+            }
+        }
+        work_done(p, cleared);
+    }
+    else {
+        pu i;
+
+        work_done(p, *get_count_ptr(p));
+        *get_count_ptr(p) = 0U;
+        for (i = 0U; i < p->lanes_num; i++) {
+            struct lane_t* const lane = &p->lanes[i];
+            cancel_lane(p, lane, NULL, -1);
+            if (p->unbounded != 0) {
+                while (lane->first != lane->last) {
+                    struct segment_t* const segment = lane->first;
+                    lane->first = segment->next;
+                    recycle_segment(p, segment);
+                }
+                lane->count = 0U;
+                lane->tail = 0U;
+            }
+            while (lane->count > 0U) {
+                sem_post(&lane->sem_add);
+                lane->count--;
+            }
+            lane->head = 0U;
+        }
+        wake_space_waiters(p);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    check_watermark(p);
+}
+
+unsigned int ctp_cancel_tag(ctpool_t pool, const void* tag)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    pu cancelled = 0U;
+
+    if ((tag != NULL) && (p->lock_free == 0)) {
+        pu i;
+
+        pthread_mutex_lock(&p->mutex);
+        for (i = 0U; i < p->lanes_num; i++) {
+            cancelled += cancel_lane(p, &p->lanes[i], tag, 0);
+        }
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    return cancelled;
+}
+
+void ctp_finish(ctpool_t pool, unsigned int* spawned)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+
+    if (p->io != NULL) {
+        wait_pool_idle((struct pool_t*)p->io, CTP_INFINITE);
+    }
+
+    ctp_resume(pool);
+
+    pthread_mutex_lock(&p->mutex);
+
+    if (p->done == 0) {
+        const pu slots = p->slots;
+        pu i;
+
+        p->done--;
+
+        if (p->lock_free != 0) {
+            atomic_store(&p->paused, 0);
+            while (wake_worker(p) != 0) {
+            }
+        }
+        else {
+            if (p->old_count != NON_PAUSED_VALUE) {
+                p->queue_count = p->old_count;
+                p->old_count = NON_PAUSED_VALUE;
+            }
+
+            for (i = 0U; i < p->waiting; i++) {
+                sem_post(&p->semaphore);
+            }
+        }
+
+        if (spawned != NULL) {
+            *spawned = slots;
+        }
+
+        pthread_mutex_unlock(&p->mutex);
+
+        wait_zero(p, &p->spawning);
+
+        for (i = 0U; i < slots; i++) {
+            if (p->locals[i]->state != SLOT_FREE) {
+                pthread_join(p->threads[i], NULL);
+            }
+        }
+
+        if (p->io != NULL) {
+            wait_zero(p, &p->helpers);
+            ctp_finish(p->io, NULL);
+        }
+
+        free_resources(p, POOL_READY);
+    }
+    else {
+        pthread_mutex_unlock(&p->mutex);
+    }
+}
+
+static pu get_count(struct pool_t* p)
+{
+    pu count;
+
+    if (p->lock_free != 0) {
+        pu i;
+
+        count = locals_count(p);
+        for (i = 0U; i < p->lanes_num; i++) {
+            count += lfq_count(&p->lanes[i].lfq);
+        }
+    }
+    else {
+        pthread_mutex_lock(&p->mutex);
+        count = (p->old_count == NON_PAUSED_VALUE) ?
+            p->queue_count : p->old_count;
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    return count;
+}
+
+int ctp_get_status(const ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    int status;
+
+    if (p->lock_free == 0) {
+        pthread_mutex_lock(&p->mutex);
+    }
+
+    status = (is_paused(p) == 0) ? 1 : -1;
+    if ((status == 1) && (p->waiting == p->running)) {
+        status = 0;
+    }
+
+    if (p->lock_free == 0) {
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    return status;
+}
+
+unsigned int ctp_get_threads_num(const ctpool_t pool)
+{
+    const struct pool_t* const p = (const struct pool_t*)pool;
+    return p->threads_num;
+}
+
+unsigned int ctp_get_live_threads_num(const ctpool_t pool)
+{
+    const struct pool_t* const p = (const struct pool_t*)pool;
+    return p->running;
+}
+
+unsigned int ctp_get_works_count(const ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    return get_count(p);
+}
+
+unsigned int ctp_get_works_count_prio(const ctpool_t pool,
+                                      unsigned int priority)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    pu count = 0U;
+
+    if (priority < p->lanes_num) {
+        const struct lane_t* const lane = &p->lanes[priority];
+
+        if (p->lock_free != 0) {
+            count = lfq_count(&lane->lfq);
+            if (priority == 0U) {
+                count += locals_count(p);
+            }
+        }
+        else {
+            pthread_mutex_lock(&p->mutex);
+            count = lane->count;
+            pthread_mutex_unlock(&p->mutex);
+        }
+    }
+
+    return count;
+}
+
+unsigned int ctp_get_queue_size(const ctpool_t pool)
+{
+    const struct pool_t* const p = (const struct pool_t*)pool;
+    return p->queue_size;
+}
+
+unsigned int ctp_get_wakeups_avoided(const ctpool_t pool)
+{
+    const struct pool_t* const p = (const struct pool_t*)pool;
+    return p->wakeups_avoided;
+}
+
+int ctp_get_stats(const ctpool_t pool, ctp_stats_t* stats)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    int enabled = 0;
+
+    memset(stats, 0, sizeof(ctp_stats_t));
+
+#ifdef CTP_STATS
+    {
+        const pu slots = p->slots;
+        pu i;
+
+        stats_sum(stats, &p->stats);
+        for (i = 0U; i < slots; i++) {
+            stats_sum(stats, &p->locals[i]->stats);
+        }
+        enabled = -1;
+    }
+#else
+    (void)p;
+#endif
+
+    return enabled;
+}
+
+unsigned int ctp_get_load_factor(const ctpool_t pool)
+{
+    struct pool_t* const p = (struct pool_t*)pool;
+    const pu count = get_count(p);
+    const float sum = (float)(p->running + count);
+    const float k = ((sum * 100.0f) / (float)p->threads_num) + 0.5f;
+    return (unsigned int)k;
+}
@@ -1,135 +1,1006 @@
-/**
- * @file      ctpool.h
- * @brief     Header of CTP (C-Thread-Pool)
- * @date      Sat Apr 10 17:29:14 2021
- * @author    Michele Pes
- * @copyright BSD-3-Clause
- */
-
-#ifndef CTPOOL_H_
-#define CTPOOL_H_
-
-typedef void* ctpool_t;
-
-/**
- * @typedef pool_worker_t
- * The signature of the functions to run, the same to be passed to pthreads
- */
-typedef void* (*pool_worker_t)(void*);
-
-/**
- * @brief Initialize a new pool
- * @details Description
- * @param[in] threads_num The number of threads that can be spawned. If you pass
- *            zero, ctp will try to guess your cores number.
- *            See ctp_get_threads_num()
- * @param[in] queue_size The size of queue. If you pass zero, ctp will calculate
- *            the queue size according to three parameters. Must be less than
- *            \a UINT_MAX. For details, see ctp_get_queue_size()
- * @param[in] block Non-zero if ctp_add_work() will block. Passing zero, if the
- *            queue is full, ctp_add_work() will fail
- * @return NULL on error, non NULL if pool is properly initialized
- */
-ctpool_t ctp_init(unsigned int threads_num, unsigned int queue_size, int block);
-
-/**
- * @brief Add passed work to pool
- * @param[in] pool The pool that will process this work
- * @param[in] func The work function to run
- * @param[in] argument The argument to pass to \a func
- * @return Non-zero if work is added, zero if not. The function will fail when
- *         the queue is full and thread is paused or cannot block 
- * @note A paused pool can receive new works
- */
-int ctp_add_work(ctpool_t pool, pool_worker_t func, void* argument);
-
-/**
- * @brief Pause a pool
- * @param[in] pool The pool to pause
- * @note Works can normally added to a paused pool. A paused pool can be
- *        regulary finished. In this case it will be resumed and terminated.
- *        Calling this function on a paused pool has no effect
- * @sa ctp_resume()
- */
-void ctp_pause(ctpool_t pool);
-
-/**
- * @brief Resume a paused pool
- * @param[in] pool The pool to resume
- * @note If you call this function on a \b non-paused pool, nothing is done
- * @sa ctp_pause()
- */
-void ctp_resume(ctpool_t pool);
-
-/**
- * @brief Clear the current queue. Works in progress won't be affected
- * @param[in] pool The pool to clear
- * @note A typical usage is when you want to immediately abort the pool.
- *        Since current works \b cannot be stopped (see ctp_pause()), you can
- *        call this function before calling ctp_finish()
- */
-void ctp_clear_queue(ctpool_t pool);
-
-/**
- * @brief Close and destroy a pool, <b>after all works</b> are done
- * @details Essentially, after calling this function all other functions cannot
- *          be called, and the pool will destroy itself when all works are done
- * @param[in] pool The pool to terminate
- * @param[out] spawned If not NULL, will receive the number of threads \b really
- *             spawned. The value is in range [0 .. ctp_get_threads_num()]
- * @note To terminate ignoring current queue, call ctp_clear_queue() before
- *        calling this function. Please note that current works will not be
- *        affected in any way. This function can be called on a paused pool.
- *        In this case, pool will be resumed and terminated
- */
-void ctp_finish(ctpool_t pool, unsigned int* spawned);
-
-/**
- * @brief Return the current pool status
- * @details The status can be paused, idle, running
- * @param[in] pool The pool to query
- * @return A negative value if paused, zero if idle or positive if running
- * @note If pool is paused, the returned value is reliable. Please do not rely
- *        on idle/running status since situation changes continuosly
- */
-int ctp_get_status(const ctpool_t pool);
-
-/**
- * @brief Query the number of threads in pool
- * @param[in] pool The pool to query
- * @return The \b maximum number that can be spawned on high load
- * @note This function is useful if you passed zero as first parameter of
- *        ctp_init(), to know if ctp correctly guess hw cores number. Otherwise,
- *        this function returns the passed value
- */
-unsigned int ctp_get_threads_num(const ctpool_t pool);
-
-/**
- * @brief Query the number of works \b currently enqueued
- * @param[in] pool The pool to query
- * @return A value in range [0..ctp_get_queue_size()]
- */
-unsigned int ctp_get_works_count(const ctpool_t pool);
-
-/**
- * @brief Query the queue size
- * @param[in] pool The pool to query
- * @return This function is useful if you passed zero as second  parameter of
- *         ctp_init(). Otherwise, this function returns the passed value.
- * @note If pool was initialized with 0, ctp calculate the queue size this way:
- *        <i>max(CTP_MIN_QUEUE_SIZE, threads_num*CTP_MULTIPLY_QUEUE_FACTOR)</i>.
- *        Note that both CTP_MIN_QUEUE_SIZE and CTP_MULTIPLY_QUEUE_FACTOR can be
- *        configured at compile time of the pool. The default value for
- *        CTP_MIN_QUEUE_SIZE is \b 256. The default value for
- *        CTP_MULTIPLY_QUEUE_FACTOR is \b 8
- */
-unsigned int ctp_get_queue_size(const ctpool_t pool);
-
-/**
- * @brief Calculate a percentage of \b current load factor
- * @param[in] pool The pool to query
- * @return A percentage of the current load factor
- */
-unsigned int ctp_get_load_factor(const ctpool_t pool);
-
-#endif /* CTPOOL_H_ */
+/**
+ * @file      ctpool.h
+ * @brief     Header of CTP (C-Thread-Pool)
+ * @date      Sat Apr 10 17:29:14 2021
+ * @author    Michele Pes
+ * @copyright BSD-3-Clause
+ */
+
+#ifndef CTPOOL_H_
+#define CTPOOL_H_
+
+#include <stddef.h>
+#include <time.h>
+
+typedef void* ctpool_t;
+
+/**
+ * @typedef ctp_future_t
+ * The completion handle of a work, see ctp_add_work_future()
+ */
+typedef void* ctp_future_t;
+
+/**
+ * @typedef ctp_timer_t
+ * The handle of a delayed or periodic work, see ctp_add_work_after().
+ * Zero is never a valid handle
+ */
+typedef unsigned long long ctp_timer_t;
+
+/**
+ * @typedef ctp_graph_t
+ * A reusable graph of works with dependency edges, see ctp_graph_create()
+ */
+typedef void* ctp_graph_t;
+
+/**
+ * @typedef ctp_strand_t
+ * A set of serial queues bound to a pool, see ctp_strand_create()
+ */
+typedef void* ctp_strand_t;
+
+/**
+ * @def CTP_INFINITE
+ * Timeout value that means "wait forever"
+ */
+#define CTP_INFINITE (0U - 1U)
+
+/**
+ * @def CTP_AFFINITY_NONE
+ * Affinity policy: threads are not pinned, see ctp_options_t::affinity
+ */
+#define CTP_AFFINITY_NONE 0
+
+/**
+ * @def CTP_AFFINITY_COMPACT
+ * Affinity policy: thread \a i is pinned to the \a i-th online cpu, so that
+ * threads fill a NUMA node before using the next one
+ */
+#define CTP_AFFINITY_COMPACT 1
+
+/**
+ * @def CTP_AFFINITY_SCATTER
+ * Affinity policy: threads are pinned to a cpu of each NUMA node in turn
+ */
+#define CTP_AFFINITY_SCATTER 2
+
+/**
+ * @def CTP_AFFINITY_CPUSET
+ * Affinity policy: thread \a i is pinned to
+ * ctp_options_t::cpus[i % ctp_options_t::cpus_num]
+ */
+#define CTP_AFFINITY_CPUSET 3
+
+/**
+ * @def CTP_AFFINITY_NODE
+ * Affinity policy: all threads may run on any cpu of NUMA node
+ * ctp_options_t::numa_node, and only there. Create one pool per node to get
+ * a pool shard per node
+ */
+#define CTP_AFFINITY_NODE 4
+
+/**
+ * @typedef pool_worker_t
+ * The signature of the functions to run, the same to be passed to pthreads
+ */
+typedef void* (*pool_worker_t)(void*);
+
+/**
+ * @typedef ctp_worker_ex_t
+ * The signature of the functions run by ctp_add_work_ex(): they also receive
+ * the index of the running thread and its context, see ctp_thread_start_t
+ */
+typedef void* (*ctp_worker_ex_t)(unsigned int index, void* context,
+                                 void* argument);
+
+/**
+ * @typedef ctp_thread_start_t
+ * Called by each pool thread when it starts, with the index of the thread
+ * in range [0..threads_num-1] and the \a hook_argument of ctp_options_t.
+ * The returned value becomes the context of the thread
+ */
+typedef void* (*ctp_thread_start_t)(unsigned int index, void* argument);
+
+/**
+ * @typedef ctp_thread_exit_t
+ * Called by each pool thread when it ends, with its index, its context and
+ * the \a hook_argument of ctp_options_t
+ */
+typedef void (*ctp_thread_exit_t)(unsigned int index, void* context,
+                                  void* argument);
+
+/**
+ * @typedef ctp_watermark_t
+ * Called when the pending works of \a pool reach the \a high_watermark of
+ * ctp_options_t, with \a high non-zero, and when they fall back to the
+ * \a low_watermark, with \a high zero. The last parameter is the
+ * \a watermark_argument of ctp_options_t
+ */
+typedef void (*ctp_watermark_t)(ctpool_t pool, int high, void* argument);
+
+/**
+ * @typedef ctp_range_worker_t
+ * The signature of the functions run by ctp_parallel_for(), called with a
+ * chunk [\a begin, \a end) of the range and the passed context
+ */
+typedef void (*ctp_range_worker_t)(size_t begin, size_t end, void* context);
+
+/**
+ * @typedef ctp_reduce_worker_t
+ * The signature of the functions run by ctp_parallel_reduce(), called with a
+ * chunk [\a begin, \a end) of the range, the accumulator of the calling
+ * thread and the passed context
+ */
+typedef void (*ctp_reduce_worker_t)(size_t begin, size_t end,
+                                    void* accumulator, void* context);
+
+/**
+ * @typedef ctp_combine_t
+ * The signature of the functions that fold an accumulator into the result of
+ * ctp_parallel_reduce()
+ */
+typedef void (*ctp_combine_t)(void* result, const void* accumulator,
+                              void* context);
+
+/**
+ * @struct ctp_work
+ * A work to run, as passed to ctp_add_works()
+ */
+typedef struct ctp_work {
+    pool_worker_t func; /**< The work function to run */
+    void* argument;     /**< The argument to pass to \a func */
+} ctp_work_t;
+
+/**
+ * @struct ctp_completion
+ * A work done, as returned by ctp_drain_completions()
+ */
+typedef struct ctp_completion {
+    void* argument; /**< The argument passed to the work function */
+    void* result;   /**< The value returned by the work function */
+} ctp_completion_t;
+
+/**
+ * @def CTP_HISTOGRAM_BUCKETS
+ * Number of buckets of the latency histograms in ctp_stats_t. Bucket \a i
+ * counts durations in [2^i, 2^(i+1)) nanoseconds, the last one is open ended
+ */
+#define CTP_HISTOGRAM_BUCKETS 32U
+
+/**
+ * @def CTP_MAX_PAYLOAD
+ * The largest payload accepted by ctp_add_work_payload(), in bytes
+ */
+#define CTP_MAX_PAYLOAD 1024U
+
+/**
+ * @struct ctp_stats
+ * A snapshot of the runtime statistics of a pool, see ctp_get_stats()
+ */
+typedef struct ctp_stats {
+    unsigned long long submitted; /**< Works accepted by the add functions */
+    unsigned long long completed; /**< Works run to completion */
+    unsigned long long rejected;  /**< Works refused by the add functions */
+    unsigned long long blocked;   /**< Times a producer blocked on a full
+                                       queue */
+    unsigned long long block_ns;  /**< Total time producers spent blocked */
+    unsigned long long idle_ns;   /**< Total time workers spent waiting for
+                                       work */
+    unsigned long long busy_ns;   /**< Total time workers spent running works */
+    /** Histogram of the time works spent queued before running */
+    unsigned long long wait_histogram[CTP_HISTOGRAM_BUCKETS];
+    /** Histogram of the execution time of works */
+    unsigned long long run_histogram[CTP_HISTOGRAM_BUCKETS];
+} ctp_stats_t;
+
+/**
+ * @struct ctp_options
+ * Extended configuration of a pool, see ctp_init_ex()
+ * @note Always fill it with ctp_options_init() before changing the fields you
+ *        need, so that new fields get a sane default
+ */
+typedef struct ctp_options {
+    /** The same as the first parameter of ctp_init() */
+    unsigned int threads_num;
+    /** The same as the second parameter of ctp_init() */
+    unsigned int queue_size;
+    /** The same as the third parameter of ctp_init() */
+    int block;
+    /**
+     * Non-zero to let a producer that finds the queue full run queued works
+     * itself until there is room for its own, or run its own work when no
+     * queued work is left to take. Works are neither lost nor waited for,
+     * and \a block is ignored. A paused pool still refuses works
+     */
+    int caller_runs;
+    /**
+     * If not NULL, called by each thread before it takes any work. Live
+     * threads always have distinct indexes, a thread that replaces a retired
+     * one reuses its index and calls this again. An idle thread calls
+     * \a thread_exit before it retires, and this again if new works call
+     * its retirement off
+     */
+    ctp_thread_start_t thread_start;
+    /** If not NULL, called by each thread after it has run its last work */
+    ctp_thread_exit_t thread_exit;
+    /** The last argument passed to \a thread_start and \a thread_exit */
+    void* hook_argument;
+    /**
+     * If not zero, \a watermark is called once the pending works, queued or
+     * running, reach this number, and not again until they fall to
+     * \a low_watermark. It lets producers slow down before the queue is full
+     */
+    unsigned int high_watermark;
+    /**
+     * The number of pending works at which \a watermark is called again,
+     * with \a high zero. Values not below \a high_watermark are lowered to
+     * \a high_watermark - 1
+     */
+    unsigned int low_watermark;
+    /**
+     * Called on each watermark crossing by the thread that crossed it, a
+     * producer or a pool thread, outside any lock of the pool. Calls for two
+     * crossings in a row may overlap. NULL disables the watermarks
+     */
+    ctp_watermark_t watermark;
+    /** The last argument passed to \a watermark */
+    void* watermark_argument;
+    /**
+     * Non-zero to enable ctp_add_work_notify(): finished works are collected
+     * in a lock-free queue and signaled through a non-blocking file
+     * descriptor, an eventfd on linux and a pipe on other POSIX systems. Not
+     * available on windows, where ctp_init_ex() fails
+     */
+    int completions;
+    /**
+     * If not zero, the pool owns a second set of up to this many threads,
+     * with its own unbounded queue, for the works added with
+     * ctp_add_work_blocking(). Its threads are spawned when needed and retire
+     * after \a keep_alive_ms, or CTP_BLOCKING_KEEP_ALIVE (default \b 1000)
+     * milliseconds if that is zero. It also runs the replacement threads of
+     * ctp_blocking_begin()
+     */
+    unsigned int blocking_threads;
+    /**
+     * Non-zero to use a lock-free bounded queue: producers and workers only
+     * use atomics while the queue is neither empty nor full. The queue size is
+     * rounded up to the next power of two, see ctp_get_queue_size()
+     */
+    int lock_free;
+    /**
+     * Non-zero to give each worker its own deque: works added from inside a
+     * worker are pushed there, and idle workers steal from random peers
+     * before falling back to the shared queue. Implies \a lock_free.
+     * The deque size is set at compile time by CTP_DEQUE_SIZE (default
+     * \b 1024), when a deque is full works go to the shared queue
+     */
+    int work_stealing;
+    /**
+     * The maximum number of works a thread takes from the queue at once and
+     * then runs back-to-back. A thread never takes more than the queued works
+     * divided by the running threads, so that short queues are shared.
+     * Values greater than
+     * CTP_MAX_DEQUEUE_BATCH (default \b 64) are clamped, zero means one.
+     * Works already taken by a thread are not affected by ctp_pause() nor
+     * by ctp_clear_queue()
+     */
+    unsigned int dequeue_batch;
+    /**
+     * The number of priority lanes, each one with its own queue. Zero or one
+     * means a single lane. Threads always serve the highest non-empty lane,
+     * but every CTP_PRIO_AGING (default \b 16) dequeues lanes are scanned in
+     * rotation, so that lower lanes cannot starve
+     */
+    unsigned int priorities;
+    /**
+     * If not NULL, an array of \a priorities sizes, one per lane. A zero item
+     * (or a NULL array) gives that lane the size of \a queue_size
+     */
+    const unsigned int* priority_sizes;
+    /**
+     * One of the CTP_AFFINITY_* policies. Threads are created already pinned,
+     * so their deques are allocated on their own node, and a thread that
+     * cannot be pinned is not started, as if its creation failed. If
+     * \a threads_num is zero, the compact and scatter policies use one thread
+     * per online cpu. The topology is read from /sys/devices/system/node, the
+     * policy is ignored on platforms other than linux
+     */
+    int affinity;
+    /**
+     * The cpus to use with CTP_AFFINITY_CPUSET. If \a threads_num is zero,
+     * one thread per item is used. ctp_init_ex() fails if an item is not
+     * below CPU_SETSIZE
+     */
+    const unsigned int* cpus;
+    /** The number of items in \a cpus */
+    unsigned int cpus_num;
+    /**
+     * The node to use with CTP_AFFINITY_NODE. If \a threads_num is zero, one
+     * thread per cpu of the node is used. The queue memory is touched from that
+     * node while the pool is created, so that it is allocated there.
+     * ctp_init_ex() fails if the node does not exist or has no cpus
+     */
+    unsigned int numa_node;
+    /**
+     * How many times an idle thread spins, with a cpu pause hint, waiting for
+     * new works before parking. Each thread adapts its own budget between
+     * \a spin_count/8 and \a spin_count: spinning that finds work doubles it,
+     * parking after spinning halves it. Zero parks at once
+     */
+    unsigned int spin_count;
+    /**
+     * How many times an idle thread yields the cpu, after spinning and before
+     * parking
+     */
+    unsigned int yield_count;
+    /**
+     * The number of threads that never retire, see \a keep_alive_ms. Threads
+     * are still spawned lazily, this is not a number of threads spawned at
+     * init
+     */
+    unsigned int min_threads;
+    /**
+     * If not zero, a thread that stays parked for this many milliseconds
+     * exits, unless the pool is paused or only \a min_threads are left. The
+     * thread is spawned again when needed, up to \a threads_num.
+     * Zero keeps all threads until ctp_finish()
+     */
+    unsigned int keep_alive_ms;
+    /**
+     * Non-zero to spawn all \a threads_num threads in ctp_init_ex(), instead
+     * of spawning them lazily when works are added. If a thread cannot be
+     * spawned, the pool is still created and spawns lazily
+     */
+    int eager;
+    /**
+     * Non-zero to store works in linked segments of CTP_SEGMENT_SIZE
+     * (default \b 256) works, allocated when needed and recycled through a
+     * free list of up to CTP_SEGMENT_CACHE (default \b 16) segments, instead
+     * of a ring of \a queue_size works. Bursts are absorbed without blocking
+     * nor discarding, up to \a queue_memory_cap. \a queue_size and
+     * \a priority_sizes are ignored. Ignored by lock-free pools
+     */
+    int unbounded;
+    /**
+     * With \a unbounded, the maximum memory used by segments, in bytes,
+     * rounded up to a whole segment. When reached, the queue behaves as full
+     * (see \a block). Zero means no limit
+     */
+    size_t queue_memory_cap;
+} ctp_options_t;
+
+/**
+ * @brief Initialize a new pool
+ * @details Description
+ * @param[in] threads_num The number of threads that can be spawned. If you pass
+ *            zero, ctp will try to guess your cores number.
+ *            See ctp_get_threads_num()
+ * @param[in] queue_size The size of queue. If you pass zero, ctp will calculate
+ *            the queue size according to three parameters. Must be less than
+ *            \a UINT_MAX. For details, see ctp_get_queue_size()
+ * @param[in] block Non-zero if ctp_add_work() will block. Passing zero, if the
+ *            queue is full, ctp_add_work() will fail
+ * @return NULL on error, non NULL if pool is properly initialized
+ */
+ctpool_t ctp_init(unsigned int threads_num, unsigned int queue_size, int block);
+
+/**
+ * @brief Fill the passed options with the default values
+ * @details Defaults are the same of ctp_init(0U, 0U, 0)
+ * @param[out] options The options to initialize
+ */
+void ctp_options_init(ctp_options_t* options);
+
+/**
+ * @brief Initialize a new pool with extended options
+ * @param[in] options The pool configuration, see ctp_options_init()
+ * @return NULL on error, non NULL if pool is properly initialized
+ * @sa ctp_init()
+ */
+ctpool_t ctp_init_ex(const ctp_options_t* options);
+
+/**
+ * @brief Add passed work to pool
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not. The function will fail when
+ *         the queue is full and thread is paused or cannot block 
+ * @note A paused pool can receive new works. With \a caller_runs (see
+ *        ctp_options_t), the work may have already run when this returns
+ */
+int ctp_add_work(ctpool_t pool, pool_worker_t func, void* argument);
+
+/**
+ * @brief Add passed work to pool, waiting for room at most a given time
+ * @details When the queue is full, the caller waits for room even if the
+ *          pool does not block, and \a caller_runs (see ctp_options_t) is
+ *          ignored
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @param[in] timeout_us The longest wait in microseconds, 0 to only try once
+ * @return Non-zero if work is added, zero if the queue is still full after
+ *         \a timeout_us or the pool is paused
+ */
+int ctp_add_work_timed(ctpool_t pool, pool_worker_t func, void* argument,
+                       unsigned int timeout_us);
+
+/**
+ * @brief Add passed work to a priority lane of pool
+ * @param[in] pool The pool that will process this work
+ * @param[in] priority The lane to use, in range [0..priorities-1]. Higher
+ *            values are served first, ctp_add_work() uses lane zero
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not. Block and discard rules are
+ *         the same of ctp_add_work() and apply to the lane capacity. The
+ *         function fails on an invalid \a priority
+ * @note With \a work_stealing, only lane zero works added from a worker go to
+ *        its deque
+ */
+int ctp_add_work_prio(ctpool_t pool, unsigned int priority,
+                      pool_worker_t func, void* argument);
+
+/**
+ * @brief Add passed work to pool, marked with a tag
+ * @details The tag is only compared by address, so it can be shared by many
+ *          works (e.g. a client connection) or unique to one of them (e.g. the
+ *          address of its argument), to be used as a cancellation handle
+ * @param[in] pool The pool that will process this work
+ * @param[in] tag The tag of the work, NULL is the same of ctp_add_work()
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not, see ctp_add_work()
+ * @sa ctp_cancel_tag()
+ */
+int ctp_add_work_tagged(ctpool_t pool, const void* tag, pool_worker_t func,
+                        void* argument);
+
+/**
+ * @brief Add passed work to pool, the function will also receive the index
+ *        and the context of the thread that runs it
+ * @details The context is the value returned by \a thread_start (see
+ *          ctp_options_t) on that thread, so works can use per-thread state
+ *          with no synchronization
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not, see ctp_add_work()
+ * @note A work run outside the pool threads (by ctp_wait_idle(), by
+ *        \a caller_runs or by a refused strand or graph) gets the index
+ *        ctp_get_threads_num() and a NULL context
+ */
+int ctp_add_work_ex(ctpool_t pool, ctp_worker_ex_t func, void* argument);
+
+/**
+ * @brief Add passed work to pool, with a copy of its argument
+ * @details Payloads up to CTP_INLINE_PAYLOAD bytes (default \b 32, set at
+ *          compile time) are copied into the queue slot itself, larger ones
+ *          into a block taken from a pool-owned slab, so no heap allocation
+ *          is done in steady state
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run. Its argument points to the copy
+ *            of \a payload, suitably aligned for any type, that is valid
+ *            until \a func returns
+ * @param[in] payload The bytes to copy
+ * @param[in] size The size of \a payload, up to CTP_MAX_PAYLOAD
+ * @return Non-zero if work is added, zero if not (see ctp_add_work()), if
+ *         \a size is too big or no block could be allocated
+ */
+int ctp_add_work_payload(ctpool_t pool, pool_worker_t func,
+                         const void* payload, size_t size);
+
+/**
+ * @brief Add passed work to pool and get a handle to its completion
+ * @details Handles come from a pool-owned slab and are recycled by
+ *          ctp_future_release(), so in steady state no heap allocation is done
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return NULL if work is not added (see ctp_add_work()) or no handle could
+ *         be allocated, a handle to be released with ctp_future_release()
+ *         otherwise
+ * @note Handles are freed with the pool, they cannot be used after
+ *        ctp_finish()
+ */
+ctp_future_t ctp_add_work_future(ctpool_t pool, pool_worker_t func,
+                                 void* argument);
+
+/**
+ * @brief Check, without blocking, if the work of a handle is done
+ * @param[in] future The handle to query
+ * @param[out] result If not NULL and work is done, will receive the value
+ *             returned by the work function
+ * @return Non-zero if work is done, zero otherwise
+ */
+int ctp_future_poll(ctp_future_t future, void** result);
+
+/**
+ * @brief Wait for the work of a handle to be done
+ * @param[in] future The handle to wait for
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. Pass
+ *            CTP_INFINITE to wait with no limit
+ * @param[out] result If not NULL and work is done, will receive the value
+ *             returned by the work function
+ * @return Non-zero if work is done, zero if timeout expired
+ */
+int ctp_future_wait(ctp_future_t future, unsigned int timeout_ms,
+                    void** result);
+
+/**
+ * @brief Give a handle back to its pool
+ * @details Can be called before the work is done, in this case the handle is
+ *          recycled when the work ends. The handle cannot be used anymore
+ * @param[in] future The handle to release
+ */
+void ctp_future_release(ctp_future_t future);
+
+/**
+ * @brief Add passed work to pool, to be collected with
+ *        ctp_drain_completions() when done
+ * @details Records come from a pool-owned slab, so no heap allocation is done
+ *          in steady state
+ * @param[in] pool The pool that will process this work, created with
+ *            \a completions (see ctp_options_t)
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not (see ctp_add_work()), if no
+ *         record could be allocated or \a completions is not set
+ */
+int ctp_add_work_notify(ctpool_t pool, pool_worker_t func, void* argument);
+
+/**
+ * @brief Get the file descriptor that becomes readable when works added with
+ *        ctp_add_work_notify() are done
+ * @details The descriptor is signaled once per batch: until
+ *          ctp_drain_completions() collects all the finished works, further
+ *          completions do no system call. Watch it for reading with
+ *          epoll/poll/select, never read it directly
+ * @param[in] pool The pool to query
+ * @return The file descriptor, owned by the pool, or -1 if \a completions is
+ *         not set
+ */
+int ctp_get_completion_fd(const ctpool_t pool);
+
+/**
+ * @brief Collect the works added with ctp_add_work_notify() that are done
+ * @details When fewer than \a max records are returned, the descriptor of
+ *          ctp_get_completion_fd() is reset, otherwise it stays readable
+ * @param[in] pool The pool to query
+ * @param[out] completions Receives the records, in completion order
+ * @param[in] max The size of \a completions
+ * @return The number of records written
+ * @note Only one thread at a time can call this function on a pool
+ */
+unsigned int ctp_drain_completions(ctpool_t pool, ctp_completion_t* completions,
+                                   unsigned int max);
+
+/**
+ * @brief Add passed work to pool when \a when is reached
+ * @details Pending timers are kept in a hierarchical timing wheel with
+ *          millisecond ticks, so insert and cancel are O(1). There is no
+ *          timer thread: an idle thread sleeps until the earliest deadline,
+ *          busy threads check it between works, and due timers are moved to
+ *          the queue in batches. Due works that do not fit in the queue run
+ *          on the thread that moved them
+ * @param[in] pool The pool that will process this work
+ * @param[in] when The absolute time, on the CLOCK_MONOTONIC clock of
+ *            clock_gettime(), so that wall clock steps do not move it
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return A handle for ctp_timer_cancel(), zero if memory is exhausted or
+ *         the pool is finishing
+ * @note Pending timers do not count for ctp_wait_idle() and are dropped by
+ *        ctp_finish()
+ */
+ctp_timer_t ctp_add_work_at(ctpool_t pool, const struct timespec* when,
+                            pool_worker_t func, void* argument);
+
+/**
+ * @brief Add passed work to pool after \a delay_ms milliseconds
+ * @details The same as ctp_add_work_at(), with a relative deadline
+ * @param[in] pool The pool that will process this work
+ * @param[in] delay_ms The delay in milliseconds
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return A handle for ctp_timer_cancel(), zero on error
+ */
+ctp_timer_t ctp_add_work_after(ctpool_t pool, unsigned int delay_ms,
+                               pool_worker_t func, void* argument);
+
+/**
+ * @brief Add passed work to pool every \a period_ms milliseconds
+ * @details The first run is after one period. Deadlines advance by whole
+ *          periods from the first one, so they do not drift. If the pool
+ *          falls behind, missed runs are skipped, not queued twice
+ * @param[in] pool The pool that will process this work
+ * @param[in] period_ms The period in milliseconds, must be non-zero
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return A handle for ctp_timer_cancel(), zero on error
+ */
+ctp_timer_t ctp_add_work_every(ctpool_t pool, unsigned int period_ms,
+                               pool_worker_t func, void* argument);
+
+/**
+ * @brief Cancel a delayed or periodic work
+ * @param[in] pool The pool of the timer
+ * @param[in] timer The handle to cancel
+ * @return Non-zero if the timer was pending and is now removed, zero if it
+ *         already fired (one-shot) or was cancelled. A periodic work already
+ *         moved to the queue still runs
+ */
+int ctp_timer_cancel(ctpool_t pool, ctp_timer_t timer);
+
+/**
+ * @brief Add many works to pool at once
+ * @details Works are enqueued in order with a single lock round-trip and only
+ *          the needed idle threads are woken up. Block and discard rules are
+ *          the same of ctp_add_work()
+ * @param[in] pool The pool that will process these works
+ * @param[in] works The works to add
+ * @param[in] count The number of items in \a works
+ * @return The number of works added, the first ones of \a works. A value less
+ *         than \a count means that the queue was full and the pool is paused
+ *         or cannot block
+ */
+unsigned int ctp_add_works(ctpool_t pool, const ctp_work_t* works,
+                           unsigned int count);
+
+/**
+ * @brief Add a work that may block for long, e.g. on disk or network I/O
+ * @details The work goes to the set of \a blocking_threads (see
+ *          ctp_options_t), so that it does not keep a thread of the pool from
+ *          running other works. Without it, this is the same of
+ *          ctp_add_work()
+ * @param[in] pool The pool that will process this work
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is added, zero if not, see ctp_add_work()
+ * @note Blocking works are not affected by ctp_pause() and
+ *        ctp_clear_queue(). ctp_wait_idle() and ctp_finish() wait for them
+ */
+int ctp_add_work_blocking(ctpool_t pool, pool_worker_t func, void* argument);
+
+/**
+ * @brief Announce that the calling work is about to block
+ * @details One of the \a blocking_threads (see ctp_options_t) starts running
+ *          the works of the pool in place of the calling thread, until
+ *          ctp_blocking_end() is called. Without \a blocking_threads nothing
+ *          is done
+ * @param[in] pool The pool running the calling work
+ * @note Every call must be paired with a call to ctp_blocking_end()
+ */
+void ctp_blocking_begin(ctpool_t pool);
+
+/**
+ * @brief Announce that the calling work does not block anymore
+ * @details The replacement thread of ctp_blocking_begin() goes back to the
+ *          blocking works once the works it took are done
+ * @param[in] pool The pool running the calling work
+ */
+void ctp_blocking_end(ctpool_t pool);
+
+/**
+ * @brief Wait until the queue is empty and all threads are idle
+ * @details Unlike ctp_finish(), the pool is still usable afterwards. While
+ *          waiting, the calling thread runs queued works too
+ * @param[in] pool The pool to wait for
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. Pass
+ *            CTP_INFINITE to wait with no limit, or zero to just check
+ * @return Non-zero if pool is idle, zero if timeout expired
+ * @note On a paused pool, queued works are waited for but not run. This
+ *        function must not be called from a work of the same pool
+ */
+int ctp_wait_idle(ctpool_t pool, unsigned int timeout_ms);
+
+/**
+ * @brief Run \a func over the range [\a begin, \a end) split in chunks
+ * @details Chunks start large and shrink as the range drains, but never go
+ *          below \a grain items. The calling thread runs chunks too, and
+ *          returns when the whole range is done
+ * @param[in] pool The pool that will help running the range
+ * @param[in] begin The first index of the range
+ * @param[in] end One past the last index of the range
+ * @param[in] grain The minimum chunk size, zero means one
+ * @param[in] func The function to run on each chunk
+ * @param[in] context The last argument passed to \a func
+ * @return Non-zero on success, zero if resources could not be allocated
+ * @note Helpers that cannot be queued (full queue on a non-blocking pool, or
+ *        a paused pool) just leave more chunks to the calling thread
+ */
+int ctp_parallel_for(ctpool_t pool, size_t begin, size_t end, size_t grain,
+                     ctp_range_worker_t func, void* context);
+
+/**
+ * @brief Reduce the range [\a begin, \a end) into \a result
+ * @details Works like ctp_parallel_for(), but each participating thread gets
+ *          its own cache line padded accumulator of \a size bytes, seeded
+ *          with a copy of \a result. When the range is done, the used
+ *          accumulators are folded into \a result by \a combine on the
+ *          calling thread
+ * @param[in] pool The pool that will help running the range
+ * @param[in] begin The first index of the range
+ * @param[in] end One past the last index of the range
+ * @param[in] grain The minimum chunk size, zero means one
+ * @param[in] func The function to run on each chunk
+ * @param[in] combine The function that folds an accumulator into \a result
+ * @param[in,out] result Holds the identity value on entry, the reduced value
+ *                on exit
+ * @param[in] size The size of \a result in bytes
+ * @param[in] context The last argument passed to \a func and \a combine
+ * @return Non-zero on success, zero if resources could not be allocated
+ */
+int ctp_parallel_reduce(ctpool_t pool, size_t begin, size_t end, size_t grain,
+                        ctp_reduce_worker_t func, ctp_combine_t combine,
+                        void* result, size_t size, void* context);
+
+/**
+ * @brief Create an empty work graph
+ * @details Nodes and edges are added with ctp_graph_add() and
+ *          ctp_graph_depend(). Once built, a graph can be run any number of
+ *          times, on any pool, with no further allocation
+ * @return NULL on error, a graph to be freed with ctp_graph_destroy()
+ *         otherwise
+ */
+ctp_graph_t ctp_graph_create(void);
+
+/**
+ * @brief Add a work node to a graph
+ * @param[in] graph The graph to extend
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @param[out] node Receives the id of the new node, to be used with
+ *             ctp_graph_depend()
+ * @return Non-zero on success, zero if memory is exhausted or the graph is
+ *         running
+ */
+int ctp_graph_add(ctp_graph_t graph, pool_worker_t func, void* argument,
+                  unsigned int* node);
+
+/**
+ * @brief Make \a node run only after \a predecessor is done
+ * @param[in] graph The graph to change
+ * @param[in] node The dependent node
+ * @param[in] predecessor The node that must be done first
+ * @return Non-zero on success, zero on invalid node ids, if memory is
+ *         exhausted or if the graph is running
+ */
+int ctp_graph_depend(ctp_graph_t graph, unsigned int node,
+                     unsigned int predecessor);
+
+/**
+ * @brief Submit all the nodes of a graph to a pool
+ * @details Nodes with no predecessor are added at once, the others when their
+ *          last predecessor is done. A finished node runs its first released
+ *          successor on the same thread, the others are added to the pool.
+ *          Nodes that cannot be added run on the releasing thread, roots on
+ *          the calling one
+ * @param[in] pool The pool that will run the graph
+ * @param[in] graph The graph to run
+ * @return Non-zero if the graph was started, zero if it is still running or
+ *         has a dependency cycle
+ * @note Use ctp_graph_wait() to know when the whole graph is done
+ */
+int ctp_graph_run(ctpool_t pool, ctp_graph_t graph);
+
+/**
+ * @brief Wait for the last run of a graph to be done
+ * @param[in] graph The graph to wait for
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. Pass
+ *            CTP_INFINITE to wait with no limit, or zero to just check
+ * @return Non-zero if the graph is done, zero if timeout expired
+ */
+int ctp_graph_wait(ctp_graph_t graph, unsigned int timeout_ms);
+
+/**
+ * @brief Free a graph
+ * @param[in] graph The graph to free, must not be running
+ */
+void ctp_graph_destroy(ctp_graph_t graph);
+
+/**
+ * @brief Create a set of strands on a pool
+ * @details Works posted to the same strand run one at a time, in order, on any
+ *          thread of \a pool, while different strands run in parallel. A
+ *          strand with works takes a single queue slot, an idle one none. To
+ *          be fair to other works, a strand gives its thread back every 32
+ *          works
+ * @param[in] pool The pool that will run the works
+ * @param[in] count The number of strands, zero means one
+ * @return NULL on error, a set of strands to be freed with
+ *         ctp_strand_destroy() otherwise
+ */
+ctp_strand_t ctp_strand_create(ctpool_t pool, unsigned int count);
+
+/**
+ * @brief Post a work to the first strand of a set
+ * @param[in] strand The set of strands
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is posted, zero if memory is exhausted
+ * @note If the pool refuses the strand, it runs on the calling thread
+ */
+int ctp_strand_post(ctp_strand_t strand, pool_worker_t func, void* argument);
+
+/**
+ * @brief Post a work to the strand chosen by hashing a key
+ * @details Works posted with the same key always go to the same strand, so
+ *          they run in order
+ * @param[in] strand The set of strands
+ * @param[in] key The key of the work, e.g. a connection id
+ * @param[in] func The work function to run
+ * @param[in] argument The argument to pass to \a func
+ * @return Non-zero if work is posted, zero if memory is exhausted
+ * @note If the pool refuses the strand, it runs on the calling thread
+ */
+int ctp_strand_post_key(ctp_strand_t strand, size_t key, pool_worker_t func,
+                        void* argument);
+
+/**
+ * @brief Wait for all the works posted to a set of strands to be done
+ * @param[in] strand The set of strands
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. Pass
+ *            CTP_INFINITE to wait with no limit, or zero to just check
+ * @return Non-zero if all strands are idle, zero if timeout expired
+ * @note This function must not be called from a work of the same strands
+ */
+int ctp_strand_wait(ctp_strand_t strand, unsigned int timeout_ms);
+
+/**
+ * @brief Wait for the posted works, then free a set of strands
+ * @param[in] strand The set of strands to free
+ * @note Must be called before ctp_finish() on the pool of the strands
+ */
+void ctp_strand_destroy(ctp_strand_t strand);
+
+/**
+ * @brief Pause a pool
+ * @param[in] pool The pool to pause
+ * @note Works can normally added to a paused pool. A paused pool can be
+ *        regulary finished. In this case it will be resumed and terminated.
+ *        No thread is spawned while paused, ctp_resume() spawns them for
+ *        the queued works. Calling this function on a paused pool has no
+ *        effect
+ * @sa ctp_resume()
+ */
+void ctp_pause(ctpool_t pool);
+
+/**
+ * @brief Resume a paused pool
+ * @param[in] pool The pool to resume
+ * @note If you call this function on a \b non-paused pool, nothing is done
+ * @sa ctp_pause()
+ */
+void ctp_resume(ctpool_t pool);
+
+/**
+ * @brief Clear the current queue. Works in progress won't be affected
+ * @param[in] pool The pool to clear
+ * @note A typical usage is when you want to immediately abort the pool.
+ *        Since current works \b cannot be stopped (see ctp_pause()), you can
+ *        call this function before calling ctp_finish()
+ */
+void ctp_clear_queue(ctpool_t pool);
+
+/**
+ * @brief Cancel all the queued works added with a given tag
+ * @details The queue is scanned once and the matching works are marked, so
+ *          threads drop them without calling their function. Until then, they
+ *          still count as queued works
+ * @param[in] pool The pool to search
+ * @param[in] tag The tag passed to ctp_add_work_tagged(), NULL matches nothing
+ * @return The number of works cancelled
+ * @note Works in progress or already taken by a thread are not affected. On
+ *        \a lock_free pools nothing is cancelled and zero is returned
+ */
+unsigned int ctp_cancel_tag(ctpool_t pool, const void* tag);
+
+/**
+ * @brief Close and destroy a pool, <b>after all works</b> are done
+ * @details Essentially, after calling this function all other functions cannot
+ *          be called, and the pool will destroy itself when all works are done
+ * @param[in] pool The pool to terminate
+ * @param[out] spawned If not NULL, will receive the number of threads \b really
+ *             spawned. The value is in range [0 .. ctp_get_threads_num()].
+ *             When threads retire, this is the peak of the live threads
+ * @note To terminate ignoring current queue, call ctp_clear_queue() before
+ *        calling this function. Please note that current works will not be
+ *        affected in any way. This function can be called on a paused pool.
+ *        In this case, pool will be resumed and terminated
+ */
+void ctp_finish(ctpool_t pool, unsigned int* spawned);
+
+/**
+ * @brief Return the current pool status
+ * @details The status can be paused, idle, running
+ * @param[in] pool The pool to query
+ * @return A negative value if paused, zero if idle or positive if running
+ * @note If pool is paused, the returned value is reliable. Please do not rely
+ *        on idle/running status since situation changes continuosly
+ */
+int ctp_get_status(const ctpool_t pool);
+
+/**
+ * @brief Query the number of threads in pool
+ * @param[in] pool The pool to query
+ * @return The \b maximum number that can be spawned on high load
+ * @note This function is useful if you passed zero as first parameter of
+ *        ctp_init(), to know if ctp correctly guess hw cores number. Otherwise,
+ *        this function returns the passed value
+ */
+unsigned int ctp_get_threads_num(const ctpool_t pool);
+
+/**
+ * @brief Query the number of threads currently alive in pool
+ * @param[in] pool The pool to query
+ * @return A value in range [0..ctp_get_threads_num()], it decreases when idle
+ *         threads retire (see ctp_options_t::keep_alive_ms)
+ */
+unsigned int ctp_get_live_threads_num(const ctpool_t pool);
+
+/**
+ * @brief Query the number of works \b currently enqueued
+ * @param[in] pool The pool to query
+ * @return A value in range [0..ctp_get_queue_size()]
+ */
+unsigned int ctp_get_works_count(const ctpool_t pool);
+
+/**
+ * @brief Query the number of works \b currently enqueued in a priority lane
+ * @param[in] pool The pool to query
+ * @param[in] priority The lane to query
+ * @return The number of works waiting in the lane, zero if \a priority is
+ *         invalid. Lane zero includes the works in the deques of a
+ *         \a work_stealing pool
+ */
+unsigned int ctp_get_works_count_prio(const ctpool_t pool,
+                                      unsigned int priority);
+
+/**
+ * @brief Query the queue size
+ * @param[in] pool The pool to query
+ * @return This function is useful if you passed zero as second  parameter of
+ *         ctp_init(). Otherwise, this function returns the passed value, or
+ *         the next power of two for a lock-free pool. With priority lanes,
+ *         the sum of the lane sizes is returned. An \a unbounded pool
+ *         returns the capacity allowed by its memory cap per lane, or
+ *         \a UINT_MAX - 1 with no cap.
+ * @note If pool was initialized with 0, ctp calculate the queue size this way:
+ *        <i>max(CTP_MIN_QUEUE_SIZE, threads_num*CTP_MULTIPLY_QUEUE_FACTOR)</i>.
+ *        Note that both CTP_MIN_QUEUE_SIZE and CTP_MULTIPLY_QUEUE_FACTOR can be
+ *        configured at compile time of the pool. The default value for
+ *        CTP_MIN_QUEUE_SIZE is \b 256. The default value for
+ *        CTP_MULTIPLY_QUEUE_FACTOR is \b 8
+ */
+unsigned int ctp_get_queue_size(const ctpool_t pool);
+
+/**
+ * @brief Query how many times an idle thread found work while spinning or
+ *        yielding, so that parking and a later wake-up were avoided
+ * @param[in] pool The pool to query
+ * @return The number of avoided wake-ups, always zero if neither
+ *         \a spin_count nor \a yield_count were set
+ */
+unsigned int ctp_get_wakeups_avoided(const ctpool_t pool);
+
+/**
+ * @brief Take a snapshot of the runtime statistics of the pool
+ * @details Counters are kept per worker and summed here, so the snapshot is
+ *          not atomic as a whole while the pool is running
+ * @param[in] pool The pool to query
+ * @param[out] stats Filled with the current statistics, or zeroed if the pool
+ *             was compiled without CTP_STATS
+ * @return Non-zero if statistics are available, zero if not
+ */
+int ctp_get_stats(const ctpool_t pool, ctp_stats_t* stats);
+
+/**
+ * @brief Calculate a percentage of \b current load factor
+ * @param[in] pool The pool to query
+ * @return A percentage of the current load factor
+ */
+unsigned int ctp_get_load_factor(const ctpool_t pool);
+
+#endif /* CTPOOL_H_ */
@@ -1,255 +1,1900 @@
-/*
-test free res
-*/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-#include <assert.h>
-#include <pthread.h>
-#include <ctpool.h>
-
-static pthread_mutex_t m;
-static size_t fib_sum;
-static unsigned int calculated;
-
-static size_t fib(size_t n)
-{
-    return (n < 2) ? n : (fib(n - 1) + fib(n - 2));
-}
-
-static void* fib_worker(void* arg)
-{
-    fib_sum = fib((size_t)arg);
-    return NULL;
-}
-
-static void* inc(void* arg)
-{
-    (void)arg;
-    pthread_mutex_lock(&m);
-    calculated++;
-    pthread_mutex_unlock(&m);
-    return NULL;
-}
-
-static void test1(void)
-{
-    ctpool_t pool;
-
-    printf("Test1...");
-
-    pool = ctp_init(3U, 3U, 0);
-    if (pool != NULL) {
-        assert(ctp_get_threads_num(pool) == 3U);
-        assert(ctp_get_queue_size(pool) == 3U);
-        assert(ctp_get_works_count(pool) == 0U);
-        assert(ctp_get_status(pool) == 0);
-        assert(ctp_get_load_factor(pool) == 0U);
-
-        ctp_pause(pool);
-        assert(ctp_get_status(pool) < 0);
-        ctp_pause(pool);
-        assert(ctp_get_status(pool) < 0);
-        ctp_resume(pool);
-        assert(ctp_get_status(pool) == 0);
-        ctp_resume(pool);
-        assert(ctp_get_status(pool) == 0);
-
-        ctp_pause(pool);
-        assert(ctp_add_work(pool, NULL, NULL) != 0);
-        assert(ctp_add_work(pool, NULL, NULL) != 0);
-        assert(ctp_add_work(pool, NULL, NULL) != 0);
-        assert(ctp_add_work(pool, NULL, NULL) == 0);
-        assert(ctp_get_works_count(pool) == 3U);
-        ctp_clear_queue(pool);
-        assert(ctp_get_works_count(pool) == 0U);
-
-        ctp_pause(pool);
-        ctp_finish(pool, NULL);
-
-        puts("OK");
-    }
-    else {
-        puts("FAILED");
-    }
-}
-
-static void test2(void)
-{
-    ctpool_t pool;
-    unsigned int i, total, rejected;
-
-    printf("Test2...");
-
-    pool = ctp_init(1U, 4U, -1);
-    if (pool != NULL) {
-        assert(ctp_get_threads_num(pool) > 0U);
-        assert(ctp_get_queue_size(pool) == 4U);
-        assert(ctp_get_works_count(pool) == 0U);
-        assert(ctp_get_status(pool) == 0);
-        assert(ctp_get_load_factor(pool) == 0U);
-
-        total = 32U << 10U;
-        rejected = 0U;
-        for (i = 0U; i < total; i++) {
-            const size_t r = (size_t)(rand() % 10);
-            if (!ctp_add_work(pool, fib_worker, (void*)r)) rejected++;
-        }
-        assert(rejected == 0U);
-
-        ctp_finish(pool, NULL);
-        puts("OK");
-    }
-    else {
-        puts("FAILED");
-    }
-}
-
-static void test3(void)
-{
-    ctpool_t pool;
-    unsigned int i, rejected, total;
-
-    printf("Test3...");
-    pool = ctp_init(0U, 0U, 0);
-    if (pool != NULL) {
-        assert(ctp_get_threads_num(pool) > 0U);
-        assert(ctp_get_queue_size(pool) == 256U);
-        assert(ctp_get_works_count(pool) == 0U);
-        assert(ctp_get_status(pool) == 0);
-        assert(ctp_get_load_factor(pool) == 0U);
-
-        total = 1U << 20U;
-        rejected = 0U;
-        for (i = 0U; i < total; i++) {
-            const size_t r = (size_t)(rand() % 10);
-            if (!ctp_add_work(pool, fib_worker, (void*)r)) rejected++;
-        }
-
-        printf("Threads: %u, Works: %u, Rejected: %u (%.1f%%): ",
-               ctp_get_threads_num(pool), total, rejected,
-               ((float)rejected / (float)total) * 100.0f);
-
-        ctp_finish(pool, NULL);
-        puts("OK");
-    }
-    else {
-        puts("FAILED");
-    }
-}
-
-static void test4(void)
-{
-    ctpool_t pool;
-    unsigned int i, total;
-
-    printf("Test4...");
-    pool = ctp_init(0U, 0U, 0);
-    if (pool != NULL) {
-        assert(ctp_get_threads_num(pool) > 0U);
-        assert(ctp_get_queue_size(pool) == 256U);
-        assert(ctp_get_works_count(pool) == 0U);
-        assert(ctp_get_status(pool) == 0);
-        assert(ctp_get_load_factor(pool) == 0U);
-
-        total = 1U << 20U;
-        for (i = 0U; i < total; i++) {
-            const size_t r = (size_t)(rand() % 10);
-            ctp_add_work(pool, fib_worker, (void*)r);
-        }
-
-        ctp_finish(pool, NULL);
-        puts("OK");
-    }
-    else {
-        puts("FAILED");
-    }
-}
-
-static void test5(void)
-{
-    ctpool_t pool;
-    unsigned int i, total, rejected;
-
-    printf("Test5...");
-    if (pthread_mutex_init(&m, NULL) == 0) {
-
-        pool = ctp_init(0U, 1024U, -1);
-        if (pool != NULL) {
-            assert(ctp_get_threads_num(pool) > 0U);
-            assert(ctp_get_queue_size(pool) == 1024U);
-            assert(ctp_get_works_count(pool) == 0U);
-            assert(ctp_get_status(pool) == 0);
-            assert(ctp_get_load_factor(pool) == 0U);
-
-            total = 2U << 20U;
-            calculated = 0U;
-            rejected = 0U;
-            for (i = 0U; i < total; i++) {
-                if (!ctp_add_work(pool, inc, NULL)) rejected++;
-            }
-            assert(rejected == 0U);
-
-            ctp_finish(pool, NULL);
-
-            assert(calculated == total);
-            puts("OK");
-        }
-
-        pthread_mutex_destroy(&m);
-    }
-}
-
-static void test6(void)
-{
-    ctpool_t pool;
-    unsigned int i, total, rejected, spawned;
-
-    printf("Test6...");
-    if (pthread_mutex_init(&m, NULL) == 0) {
-
-        pool = ctp_init(2U << 20U, 2U, -1);
-        if (pool != NULL) {
-            assert(ctp_get_threads_num(pool) > 0U);
-            assert(ctp_get_queue_size(pool) == 2U);
-            assert(ctp_get_works_count(pool) == 0U);
-            assert(ctp_get_status(pool) == 0);
-            assert(ctp_get_load_factor(pool) == 0U);
-
-            total = 2U << 20U;
-            calculated = 0U;
-            rejected = 0U;
-            for (i = 0U; i < total; i++) {
-                if (!ctp_add_work(pool, inc, NULL)) rejected++;
-            }
-
-            ctp_finish(pool, &spawned);
-
-            printf("Threads: %u, Spawned: %u, Works: %u, "
-                   "Rejected: %u (%.1f%%): ", ctp_get_threads_num(pool),
-                   spawned, total, rejected,
-                   ((float)rejected / (float)total) * 100.0f);
-
-            puts("OK");
-        }
-
-        pthread_mutex_destroy(&m);
-    }
-}
-
-int main(void)
-{
-    srand((unsigned int)time(NULL));
-
-    test1();
-    test2();
-    test3();
-    test4();
-    test5();
-    test6();
-
-    puts("\npool done");
-
-    return 0;
-}
+/*
+test free res
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <ctpool.h>
+
+static pthread_mutex_t m;
+static size_t fib_sum;
+static unsigned int calculated;
+static ctpool_t split_pool;
+static size_t order[256];
+static atomic_uint in_strand[16];
+static size_t strand_next[16];
+static atomic_uint hook_starts;
+static atomic_uint hook_exits;
+static atomic_uint hook_total;
+static atomic_uint empty_payloads;
+static ctpool_t blocking_pool;
+static atomic_int gate;
+static atomic_uint marks_high;
+static atomic_uint marks_low;
+
+static void sleep_ms(unsigned int ms)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000U);
+    ts.tv_nsec = (long)(ms % 1000U) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+static size_t fib(size_t n)
+{
+    return (n < 2) ? n : (fib(n - 1) + fib(n - 2));
+}
+
+static void* fib_worker(void* arg)
+{
+    fib_sum = fib((size_t)arg);
+    return NULL;
+}
+
+static void* inc(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&m);
+    calculated++;
+    pthread_mutex_unlock(&m);
+    return NULL;
+}
+
+static void* check_payload(void* arg)
+{
+    const unsigned char* const bytes = (const unsigned char*)arg;
+    unsigned int size, i;
+    int ok = (((size_t)arg % sizeof(double)) == 0U);
+
+    memcpy(&size, bytes, sizeof(size));
+    for (i = (unsigned int)sizeof(size); i < size; i++) {
+        ok = ok && (bytes[i] == (unsigned char)i);
+    }
+    if (ok) {
+        inc(NULL);
+    }
+
+    return NULL;
+}
+
+static void* count_empty(void* arg)
+{
+    assert(arg != NULL);
+    atomic_fetch_add(&empty_payloads, 1U);
+    return NULL;
+}
+
+static void* inc_where(void* arg)
+{
+    const pthread_t* const caller = (const pthread_t*)arg;
+    pthread_mutex_lock(&m);
+    calculated++;
+    if (pthread_equal(pthread_self(), *caller)) {
+        fib_sum++;
+    }
+    pthread_mutex_unlock(&m);
+    return NULL;
+}
+
+static void* nap(void* arg)
+{
+    (void)arg;
+    sleep_ms(50U);
+    return NULL;
+}
+
+static void* blocker(void* arg)
+{
+    unsigned int waited = 0U;
+    unsigned int done = 0U;
+
+    ctp_blocking_begin(blocking_pool);
+    while ((done < *(unsigned int*)arg) && (waited < 5000U)) {
+        sleep_ms(1U);
+        waited++;
+        pthread_mutex_lock(&m);
+        done = calculated;
+        pthread_mutex_unlock(&m);
+    }
+    ctp_blocking_end(blocking_pool);
+
+    pthread_mutex_lock(&m);
+    if (done >= *(unsigned int*)arg) {
+        fib_sum++;
+    }
+    pthread_mutex_unlock(&m);
+    return NULL;
+}
+
+static void* wait_gate(void* arg)
+{
+    (void)arg;
+    while (atomic_load(&gate) == 0) {
+        sleep_ms(1U);
+    }
+    return NULL;
+}
+
+static void on_signal(int signal)
+{
+    (void)signal;
+}
+
+static void* interrupt(void* arg)
+{
+    sleep_ms(10U);
+    pthread_kill(*(const pthread_t*)arg, SIGUSR1);
+    return NULL;
+}
+
+static void on_watermark(ctpool_t pool, int high, void* arg)
+{
+    assert(pool == *(ctpool_t*)arg);
+    if (high != 0) {
+        atomic_fetch_add(&marks_high, 1U);
+    }
+    else {
+        atomic_fetch_add(&marks_low, 1U);
+    }
+}
+
+static void* strand_step(void* arg)
+{
+    const size_t value = (size_t)arg;
+    const size_t key = value % 16U;
+
+    if ((atomic_fetch_add(&in_strand[key], 1U) == 0U)
+        && (strand_next[key] == (value / 16U)))
+    {
+        strand_next[key]++;
+    }
+    atomic_fetch_sub(&in_strand[key], 1U);
+
+    return NULL;
+}
+
+static void* hook_start(unsigned int index, void* arg)
+{
+    unsigned int* const count = (unsigned int*)malloc(sizeof(unsigned int));
+    assert(index < *(unsigned int*)arg);
+    *count = 0U;
+    atomic_fetch_add(&hook_starts, 1U);
+    return count;
+}
+
+static void hook_exit(unsigned int index, void* context, void* arg)
+{
+    unsigned int* const count = (unsigned int*)context;
+    assert(index < *(unsigned int*)arg);
+    atomic_fetch_add(&hook_total, *count);
+    atomic_fetch_add(&hook_exits, 1U);
+    free(count);
+}
+
+static void* count_ex(unsigned int index, void* context, void* arg)
+{
+    unsigned int* const count = (unsigned int*)context;
+
+    if (count != NULL) {
+        assert(index < *(unsigned int*)arg);
+        (*count)++;
+    }
+    else {
+        assert(index == *(unsigned int*)arg);
+        atomic_fetch_add(&hook_total, 1U);
+    }
+
+    return NULL;
+}
+
+static void* twice(void* arg)
+{
+    return (void*)((size_t)arg * 2U);
+}
+
+static void* produce(void* arg)
+{
+    unsigned int i;
+    for (i = 0U; i < 5000U; i++) {
+        assert(ctp_add_work(*(ctpool_t*)arg, twice, NULL) != 0);
+    }
+    return NULL;
+}
+
+static void exit_add(unsigned int index, void* context, void* arg)
+{
+    (void)index;
+    (void)context;
+    sleep_ms(5U);
+    if (atomic_fetch_add(&hook_exits, 1U) < 4U) {
+        ctp_add_work(*(ctpool_t*)arg, twice, NULL);
+    }
+}
+
+static void* record(void* arg)
+{
+    pthread_mutex_lock(&m);
+    order[calculated++] = (size_t)arg;
+    pthread_mutex_unlock(&m);
+    return NULL;
+}
+
+static void* split(void* arg)
+{
+    const size_t n = (size_t)arg;
+
+    if (n < 2U) {
+        inc(NULL);
+    }
+    else {
+        ctp_add_work(split_pool, split, (void*)(n - 1U));
+        ctp_add_work(split_pool, split, (void*)(n - 2U));
+    }
+
+    return NULL;
+}
+
+static void fill_double(size_t begin, size_t end, void* context)
+{
+    size_t* const values = (size_t*)context;
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        values[i] = i * 2U;
+    }
+}
+
+static void sum_range(size_t begin, size_t end, void* accumulator,
+                      void* context)
+{
+    size_t* const sum = (size_t*)accumulator;
+    size_t i;
+
+    (void)context;
+    for (i = begin; i < end; i++) {
+        *sum += i;
+    }
+}
+
+static void sum_combine(void* result, const void* accumulator, void* context)
+{
+    (void)context;
+    *(size_t*)result += *(const size_t*)accumulator;
+}
+
+static void test1(void)
+{
+    ctpool_t pool;
+
+    printf("Test1...");
+
+    pool = ctp_init(3U, 3U, 0);
+    if (pool != NULL) {
+        assert(ctp_get_threads_num(pool) == 3U);
+        assert(ctp_get_queue_size(pool) == 3U);
+        assert(ctp_get_works_count(pool) == 0U);
+        assert(ctp_get_status(pool) == 0);
+        assert(ctp_get_load_factor(pool) == 0U);
+
+        ctp_pause(pool);
+        assert(ctp_get_status(pool) < 0);
+        ctp_pause(pool);
+        assert(ctp_get_status(pool) < 0);
+        ctp_resume(pool);
+        assert(ctp_get_status(pool) == 0);
+        ctp_resume(pool);
+        assert(ctp_get_status(pool) == 0);
+
+        ctp_pause(pool);
+        assert(ctp_add_work(pool, NULL, NULL) != 0);
+        assert(ctp_add_work(pool, NULL, NULL) != 0);
+        assert(ctp_add_work(pool, NULL, NULL) != 0);
+        assert(ctp_add_work(pool, NULL, NULL) == 0);
+        assert(ctp_get_works_count(pool) == 3U);
+        ctp_clear_queue(pool);
+        assert(ctp_get_works_count(pool) == 0U);
+
+        ctp_pause(pool);
+        ctp_finish(pool, NULL);
+
+        puts("OK");
+    }
+    else {
+        puts("FAILED");
+    }
+}
+
+static void test2(void)
+{
+    ctpool_t pool;
+    unsigned int i, total, rejected;
+
+    printf("Test2...");
+
+    pool = ctp_init(1U, 4U, -1);
+    if (pool != NULL) {
+        assert(ctp_get_threads_num(pool) > 0U);
+        assert(ctp_get_queue_size(pool) == 4U);
+        assert(ctp_get_works_count(pool) == 0U);
+        assert(ctp_get_status(pool) == 0);
+        assert(ctp_get_load_factor(pool) == 0U);
+
+        total = 32U << 10U;
+        rejected = 0U;
+        for (i = 0U; i < total; i++) {
+            const size_t r = (size_t)(rand() % 10);
+            if (!ctp_add_work(pool, fib_worker, (void*)r)) rejected++;
+        }
+        assert(rejected == 0U);
+
+        ctp_finish(pool, NULL);
+        puts("OK");
+    }
+    else {
+        puts("FAILED");
+    }
+}
+
+static void test3(void)
+{
+    ctpool_t pool;
+    unsigned int i, rejected, total;
+
+    printf("Test3...");
+    pool = ctp_init(0U, 0U, 0);
+    if (pool != NULL) {
+        assert(ctp_get_threads_num(pool) > 0U);
+        assert(ctp_get_queue_size(pool) == 256U);
+        assert(ctp_get_works_count(pool) == 0U);
+        assert(ctp_get_status(pool) == 0);
+        assert(ctp_get_load_factor(pool) == 0U);
+
+        total = 1U << 20U;
+        rejected = 0U;
+        for (i = 0U; i < total; i++) {
+            const size_t r = (size_t)(rand() % 10);
+            if (!ctp_add_work(pool, fib_worker, (void*)r)) rejected++;
+        }
+
+        printf("Threads: %u, Works: %u, Rejected: %u (%.1f%%): ",
+               ctp_get_threads_num(pool), total, rejected,
+               ((float)rejected / (float)total) * 100.0f);
+
+        ctp_finish(pool, NULL);
+        puts("OK");
+    }
+    else {
+        puts("FAILED");
+    }
+}
+
+static void test4(void)
+{
+    ctpool_t pool;
+    unsigned int i, total;
+
+    printf("Test4...");
+    pool = ctp_init(0U, 0U, 0);
+    if (pool != NULL) {
+        assert(ctp_get_threads_num(pool) > 0U);
+        assert(ctp_get_queue_size(pool) == 256U);
+        assert(ctp_get_works_count(pool) == 0U);
+        assert(ctp_get_status(pool) == 0);
+        assert(ctp_get_load_factor(pool) == 0U);
+
+        total = 1U << 20U;
+        for (i = 0U; i < total; i++) {
+            const size_t r = (size_t)(rand() % 10);
+            ctp_add_work(pool, fib_worker, (void*)r);
+        }
+
+        ctp_finish(pool, NULL);
+        puts("OK");
+    }
+    else {
+        puts("FAILED");
+    }
+}
+
+static void test5(void)
+{
+    ctpool_t pool;
+    unsigned int i, total, rejected;
+
+    printf("Test5...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        pool = ctp_init(0U, 1024U, -1);
+        if (pool != NULL) {
+            assert(ctp_get_threads_num(pool) > 0U);
+            assert(ctp_get_queue_size(pool) == 1024U);
+            assert(ctp_get_works_count(pool) == 0U);
+            assert(ctp_get_status(pool) == 0);
+            assert(ctp_get_load_factor(pool) == 0U);
+
+            total = 2U << 20U;
+            calculated = 0U;
+            rejected = 0U;
+            for (i = 0U; i < total; i++) {
+                if (!ctp_add_work(pool, inc, NULL)) rejected++;
+            }
+            assert(rejected == 0U);
+
+            ctp_finish(pool, NULL);
+
+            assert(calculated == total);
+            puts("OK");
+        }
+
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test6(void)
+{
+    ctpool_t pool;
+    unsigned int i, total, rejected, spawned;
+
+    printf("Test6...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        pool = ctp_init(2U << 20U, 2U, -1);
+        if (pool != NULL) {
+            assert(ctp_get_threads_num(pool) > 0U);
+            assert(ctp_get_queue_size(pool) == 2U);
+            assert(ctp_get_works_count(pool) == 0U);
+            assert(ctp_get_status(pool) == 0);
+            assert(ctp_get_load_factor(pool) == 0U);
+
+            total = 2U << 20U;
+            calculated = 0U;
+            rejected = 0U;
+            for (i = 0U; i < total; i++) {
+                if (!ctp_add_work(pool, inc, NULL)) rejected++;
+            }
+
+            ctp_finish(pool, &spawned);
+
+            printf("Threads: %u, Spawned: %u, Works: %u, "
+                   "Rejected: %u (%.1f%%): ", ctp_get_threads_num(pool),
+                   spawned, total, rejected,
+                   ((float)rejected / (float)total) * 100.0f);
+
+            puts("OK");
+        }
+
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test7(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, total, rejected;
+
+    printf("Test7...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        ctp_options_init(&options);
+        options.queue_size = 3U;
+        options.lock_free = -1;
+        pool = ctp_init_ex(&options);
+        if (pool != NULL) {
+            assert(ctp_get_queue_size(pool) == 4U);
+            assert(ctp_get_works_count(pool) == 0U);
+            assert(ctp_get_status(pool) == 0);
+
+            ctp_pause(pool);
+            assert(ctp_get_status(pool) < 0);
+            for (i = 0U; i < 4U; i++) {
+                assert(ctp_add_work(pool, inc, NULL) != 0);
+            }
+            assert(ctp_add_work(pool, inc, NULL) == 0);
+            assert(ctp_get_works_count(pool) == 4U);
+            ctp_clear_queue(pool);
+            assert(ctp_get_works_count(pool) == 0U);
+            ctp_resume(pool);
+            ctp_finish(pool, NULL);
+
+            options.queue_size = 1024U;
+            options.block = -1;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            total = 2U << 20U;
+            calculated = 0U;
+            rejected = 0U;
+            for (i = 0U; i < total; i++) {
+                if (!ctp_add_work(pool, inc, NULL)) rejected++;
+            }
+            assert(rejected == 0U);
+
+            ctp_finish(pool, NULL);
+
+            assert(calculated == total);
+            puts("OK");
+        }
+
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test8(void)
+{
+    ctp_options_t options;
+
+    printf("Test8...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        ctp_options_init(&options);
+        options.block = -1;
+        options.work_stealing = -1;
+        split_pool = ctp_init_ex(&options);
+        if (split_pool != NULL) {
+            assert(ctp_get_queue_size(split_pool) == 256U);
+            assert(ctp_get_works_count(split_pool) == 0U);
+
+            calculated = 0U;
+            assert(ctp_add_work(split_pool, split, (void*)20U) != 0);
+
+            ctp_finish(split_pool, NULL);
+
+            assert(calculated == (unsigned int)fib(21U));
+            puts("OK");
+        }
+
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test9(void)
+{
+    ctp_options_t options;
+    ctp_work_t works[100];
+    ctpool_t pool;
+    unsigned int i, total, added;
+    int lock_free;
+
+    printf("Test9...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (i = 0U; i < 100U; i++) {
+            works[i].func = inc;
+            works[i].argument = NULL;
+        }
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.queue_size = 4U;
+            options.lock_free = lock_free;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            ctp_pause(pool);
+            assert(ctp_add_works(pool, works, 6U) == 4U);
+            assert(ctp_get_works_count(pool) == 4U);
+            assert(ctp_get_live_threads_num(pool) == 0U);
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 4U);
+            ctp_pause(pool);
+            assert(ctp_add_works(pool, works, 3U) == 3U);
+            ctp_finish(pool, NULL);
+            assert(calculated == 7U);
+
+            options.queue_size = 64U;
+            options.block = -1;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            total = 0U;
+            calculated = 0U;
+            for (i = 0U; i < 1000U; i++) {
+                added = ctp_add_works(pool, works, 100U);
+                assert(added == 100U);
+                total += added;
+            }
+
+            ctp_finish(pool, NULL);
+            assert(calculated == total);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test10(void)
+{
+    ctp_options_t options;
+    ctp_work_t works[64];
+    ctpool_t pool;
+    unsigned int i;
+    int lock_free;
+
+    printf("Test10...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (i = 0U; i < 64U; i++) {
+            works[i].func = inc;
+            works[i].argument = NULL;
+        }
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.queue_size = 1024U;
+            options.block = -1;
+            options.lock_free = lock_free;
+            options.dequeue_batch = 16U;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            for (i = 0U; i < (1U << 14U); i++) {
+                assert(ctp_add_works(pool, works, 64U) == 64U);
+            }
+
+            ctp_finish(pool, NULL);
+            assert(calculated == (64U << 14U));
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test11(void)
+{
+    ctp_options_t options;
+    ctp_future_t futures[64];
+    ctpool_t pool;
+    void* result;
+    size_t i;
+    int lock_free;
+
+    printf("Test11...");
+
+    for (lock_free = 0; lock_free < 2; lock_free++) {
+        ctp_options_init(&options);
+        options.block = -1;
+        options.lock_free = lock_free;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        ctp_pause(pool);
+        futures[0] = ctp_add_work_future(pool, twice, (void*)21U);
+        assert(futures[0] != NULL);
+        assert(ctp_future_poll(futures[0], &result) == 0);
+        assert(ctp_future_wait(futures[0], 10U, &result) == 0);
+        ctp_resume(pool);
+        assert(ctp_future_wait(futures[0], CTP_INFINITE, &result) != 0);
+        assert((size_t)result == 42U);
+        assert(ctp_future_poll(futures[0], NULL) != 0);
+        ctp_future_release(futures[0]);
+
+        for (i = 0U; i < 64U; i++) {
+            futures[i] = ctp_add_work_future(pool, twice, (void*)i);
+            assert(futures[i] != NULL);
+        }
+        for (i = 0U; i < 64U; i += 2U) {
+            ctp_future_release(futures[i]);
+        }
+        for (i = 1U; i < 64U; i += 2U) {
+            assert(ctp_future_wait(futures[i], CTP_INFINITE, &result) != 0);
+            assert((size_t)result == (i * 2U));
+            ctp_future_release(futures[i]);
+        }
+
+        ctp_finish(pool, NULL);
+    }
+
+    puts("OK");
+}
+
+static void test12(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, round;
+    int lock_free;
+
+    printf("Test12...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.queue_size = 64U;
+            options.block = -1;
+            options.lock_free = lock_free;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+            assert(ctp_wait_idle(pool, 0U) != 0);
+
+            calculated = 0U;
+            for (round = 1U; round <= 4U; round++) {
+                for (i = 0U; i < 10000U; i++) {
+                    assert(ctp_add_work(pool, inc, NULL) != 0);
+                }
+                assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+                assert(calculated == (round * 10000U));
+                assert(ctp_get_works_count(pool) == 0U);
+            }
+
+            ctp_pause(pool);
+            assert(ctp_add_work(pool, inc, NULL) != 0);
+            assert(ctp_wait_idle(pool, 10U) == 0);
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 40001U);
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test13(void)
+{
+    static const unsigned int sizes[3] = { 0U, 4U, 0U };
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, first_low;
+    int lock_free;
+
+    printf("Test13...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.threads_num = 1U;
+            options.queue_size = 128U;
+            options.lock_free = lock_free;
+            options.priorities = 3U;
+            options.priority_sizes = sizes;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+            assert(ctp_get_queue_size(pool) == 260U);
+
+            ctp_pause(pool);
+            calculated = 0U;
+            for (i = 0U; i < 100U; i++) {
+                assert(ctp_add_work(pool, record, (void*)0U) != 0);
+                assert(ctp_add_work_prio(pool, 2U, record, (void*)2U) != 0);
+            }
+            for (i = 0U; i < 4U; i++) {
+                assert(ctp_add_work_prio(pool, 1U, record, (void*)1U) != 0);
+            }
+            assert(ctp_add_work_prio(pool, 1U, record, (void*)1U) == 0);
+            assert(ctp_add_work_prio(pool, 3U, record, (void*)3U) == 0);
+            assert(ctp_get_works_count_prio(pool, 0U) == 100U);
+            assert(ctp_get_works_count_prio(pool, 1U) == 4U);
+            assert(ctp_get_works_count_prio(pool, 2U) == 100U);
+            assert(ctp_get_works_count_prio(pool, 3U) == 0U);
+            assert(ctp_get_works_count(pool) == 204U);
+
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 204U);
+
+            for (i = 0U; i < 8U; i++) {
+                assert(order[i] == 2U);
+            }
+            first_low = 0U;
+            while (order[first_low] != 0U) {
+                first_low++;
+            }
+            assert(first_low < 100U);
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test14(void)
+{
+    static const unsigned int cpus[1] = { 0U };
+    static const unsigned int far[1] = { 1U << 20 };
+    static const unsigned int absent[1] = { 1023U };
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i;
+    int affinity;
+
+    printf("Test14...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (affinity = CTP_AFFINITY_NONE; affinity <= CTP_AFFINITY_NODE;
+             affinity++)
+        {
+            ctp_options_init(&options);
+            options.block = -1;
+            options.affinity = affinity;
+            options.cpus = cpus;
+            options.cpus_num = 1U;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+            if (affinity == CTP_AFFINITY_CPUSET) {
+                assert(ctp_get_threads_num(pool) == 1U);
+            }
+
+            calculated = 0U;
+            for (i = 0U; i < 1000U; i++) {
+                assert(ctp_add_work(pool, inc, NULL) != 0);
+            }
+            ctp_finish(pool, NULL);
+            assert(calculated == 1000U);
+        }
+
+        ctp_options_init(&options);
+        options.affinity = CTP_AFFINITY_CPUSET;
+        assert(ctp_init_ex(&options) == NULL);
+
+#ifdef __linux__
+        options.affinity = CTP_AFFINITY_NODE;
+        options.numa_node = 100000U;
+        assert(ctp_init_ex(&options) == NULL);
+
+        ctp_options_init(&options);
+        options.affinity = CTP_AFFINITY_CPUSET;
+        options.cpus = far;
+        options.cpus_num = 1U;
+        assert(ctp_init_ex(&options) == NULL);
+
+        options.cpus = absent;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+        assert(ctp_add_work(pool, inc, NULL) == 0);
+        assert(ctp_get_live_threads_num(pool) == 0U);
+        ctp_finish(pool, NULL);
+#endif
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test15(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    ctp_future_t future;
+    unsigned int i;
+    int lock_free, spin;
+    void* result;
+
+    printf("Test15...");
+    for (lock_free = 0; lock_free < 2; lock_free++) {
+        for (spin = 0; spin < 2; spin++) {
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.lock_free = lock_free;
+            if (spin != 0) {
+                options.spin_count = 4096U;
+                options.yield_count = 1024U;
+            }
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            for (i = 0U; i < 200U; i++) {
+                future = ctp_add_work_future(pool, twice, (void*)(size_t)i);
+                assert(future != NULL);
+                assert(ctp_future_wait(future, CTP_INFINITE, &result) != 0);
+                assert((size_t)result == (size_t)(i * 2U));
+                ctp_future_release(future);
+            }
+
+            assert((ctp_get_wakeups_avoided(pool) > 0U) == (spin != 0));
+            ctp_finish(pool, NULL);
+        }
+    }
+    puts("OK");
+}
+
+static void test16(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, round, spawned;
+    int mode;
+
+    printf("Test16...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (mode = 0; mode < 3; mode++) {
+            ctp_options_init(&options);
+            options.threads_num = 4U;
+            options.block = -1;
+            options.lock_free = (mode > 0);
+            options.work_stealing = (mode > 1);
+            options.min_threads = 1U;
+            options.keep_alive_ms = 20U;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            for (round = 1U; round <= 3U; round++) {
+                for (i = 0U; i < 10000U; i++) {
+                    assert(ctp_add_work(pool, inc, NULL) != 0);
+                }
+                assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+                assert(calculated == (round * 10000U));
+
+                i = 0U;
+                while ((ctp_get_live_threads_num(pool) > 1U) && (i < 500U)) {
+                    sleep_ms(10U);
+                    i++;
+                }
+                assert(ctp_get_live_threads_num(pool) == 1U);
+            }
+
+            ctp_finish(pool, &spawned);
+            assert((spawned >= 1U) && (spawned <= 4U));
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+#if defined(__linux__) && !defined(__SANITIZE_ADDRESS__) \
+    && !defined(__SANITIZE_THREAD__)
+#define CAN_FAIL_SPAWN
+static void* hold_stack(void* arg)
+{
+    pthread_mutex_lock((pthread_mutex_t*)arg);
+    return NULL;
+}
+
+static int spawn_fails(int lock_free)
+{
+    const pid_t child = fork();
+    int status = -1;
+
+    if (child == 0) {
+        static pthread_mutex_t hold = PTHREAD_MUTEX_INITIALIZER;
+        ctp_options_t options;
+        ctpool_t pool;
+        pthread_t holders[16];
+        struct rlimit limit;
+        unsigned long pages = 0UL;
+        FILE* statm;
+        unsigned int i;
+
+        pthread_mutex_lock(&hold);
+        for (i = 0U; i < 16U; i++) {
+            pthread_create(&holders[i], NULL, hold_stack, &hold);
+        }
+        statm = fopen("/proc/self/statm", "r");
+
+        ctp_options_init(&options);
+        options.threads_num = 2U;
+        options.lock_free = lock_free;
+        pool = ctp_init_ex(&options);
+
+        if ((pool == NULL) || (statm == NULL)
+            || (fscanf(statm, "%lu", &pages) != 1))
+        {
+            _exit(2);
+        }
+        fclose(statm);
+
+        limit.rlim_cur = ((rlim_t)pages * (rlim_t)sysconf(_SC_PAGESIZE))
+                         + (1024U * 1024U);
+        limit.rlim_max = limit.rlim_cur;
+        if (setrlimit(RLIMIT_AS, &limit) != 0) {
+            _exit(2);
+        }
+
+        _exit(((ctp_add_work(pool, twice, NULL) == 0)
+               && (ctp_get_works_count(pool) == 0U)
+               && (ctp_get_live_threads_num(pool) == 0U)) ? 0 : 1);
+    }
+    else if (child > 0) {
+        waitpid(child, &status, 0);
+    }
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+#endif
+
+static void test17(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, spawned;
+    int lock_free;
+
+    printf("Test17...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.threads_num = 4U;
+            options.block = -1;
+            options.lock_free = lock_free;
+            options.eager = -1;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+            assert(ctp_get_live_threads_num(pool) == 4U);
+
+            calculated = 0U;
+            for (i = 0U; i < 10000U; i++) {
+                assert(ctp_add_work(pool, inc, NULL) != 0);
+            }
+            ctp_finish(pool, &spawned);
+            assert(spawned == 4U);
+            assert(calculated == 10000U);
+
+#ifdef CAN_FAIL_SPAWN
+            assert(spawn_fails(lock_free) != 0);
+#endif
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test18(void)
+{
+    ctp_options_t options;
+    ctpool_t pool;
+    unsigned int i, size, added;
+    int capped;
+
+    printf("Test18...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (capped = 0; capped < 2; capped++) {
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.unbounded = -1;
+            options.queue_memory_cap = (size_t)capped;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+            size = ctp_get_queue_size(pool);
+            assert((capped != 0) || (size > 100000U));
+
+            ctp_pause(pool);
+            calculated = 0U;
+            added = 0U;
+            for (i = 0U; i < 100000U; i++) {
+                if (ctp_add_work(pool, inc, NULL) != 0) {
+                    added++;
+                }
+            }
+            assert(added == ((capped != 0) ? size : 100000U));
+            assert(ctp_get_works_count(pool) == added);
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == added);
+            ctp_finish(pool, NULL);
+        }
+
+        ctp_options_init(&options);
+        options.threads_num = 2U;
+        options.block = -1;
+        options.unbounded = -1;
+        options.queue_memory_cap = 1U;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+        calculated = 0U;
+        for (i = 0U; i < 100000U; i++) {
+            assert(ctp_add_work(pool, inc, NULL) != 0);
+        }
+        ctp_finish(pool, NULL);
+        assert(calculated == 100000U);
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test19(void)
+{
+    ctp_options_t options;
+    ctp_stats_t stats;
+    ctpool_t pool;
+    unsigned int i, added;
+    unsigned long long waits, runs;
+    int lock_free, enabled;
+
+    printf("Test19...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.queue_size = 8U;
+            options.lock_free = lock_free;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            ctp_pause(pool);
+            calculated = 0U;
+            added = 0U;
+            for (i = 0U; i < 100U; i++) {
+                if (ctp_add_work(pool, inc, NULL) != 0) {
+                    added++;
+                }
+            }
+            assert((added > 0U) && (added < 100U));
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == added);
+
+            enabled = ctp_get_stats(pool, &stats);
+            waits = 0U;
+            runs = 0U;
+            for (i = 0U; i < CTP_HISTOGRAM_BUCKETS; i++) {
+                waits += stats.wait_histogram[i];
+                runs += stats.run_histogram[i];
+            }
+            if (enabled != 0) {
+                assert(stats.submitted == added);
+                assert(stats.rejected == (100U - added));
+                assert(stats.completed == added);
+                assert((waits == added) && (runs == added));
+            }
+            else {
+                assert((stats.submitted == 0U) && (stats.completed == 0U));
+                assert((waits == 0U) && (runs == 0U));
+            }
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test20(void)
+{
+    static size_t values[10000];
+    ctp_options_t options;
+    ctpool_t pool;
+    size_t i, sum;
+    int mode;
+
+    printf("Test20...");
+
+    for (mode = 0; mode < 3; mode++) {
+        ctp_options_init(&options);
+        options.threads_num = 4U;
+        options.lock_free = (mode == 1) ? -1 : 0;
+        options.work_stealing = (mode == 2) ? -1 : 0;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        assert(ctp_parallel_for(pool, 0U, 10000U, 16U, fill_double,
+                                values) != 0);
+        for (i = 0U; i < 10000U; i++) {
+            assert(values[i] == (i * 2U));
+        }
+
+        sum = 0U;
+        assert(ctp_parallel_reduce(pool, 0U, 10000U, 0U, sum_range,
+                                   sum_combine, &sum, sizeof(sum),
+                                   NULL) != 0);
+        assert(sum == 49995000U);
+
+        sum = 7U;
+        assert(ctp_parallel_reduce(pool, 5U, 5U, 1U, sum_range, sum_combine,
+                                   &sum, sizeof(sum), NULL) != 0);
+        assert(sum == 7U);
+
+        ctp_pause(pool);
+        sum = 0U;
+        assert(ctp_parallel_reduce(pool, 1U, 101U, 10U, sum_range,
+                                   sum_combine, &sum, sizeof(sum),
+                                   NULL) != 0);
+        assert(sum == 5050U);
+        ctp_clear_queue(pool);
+        ctp_resume(pool);
+
+        ctp_finish(pool, NULL);
+
+        options.threads_num = 1U;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        atomic_store(&gate, 0);
+        assert(ctp_add_work(pool, wait_gate, NULL) != 0);
+        while (ctp_get_works_count(pool) > 0U) {
+            sleep_ms(1U);
+        }
+        assert(ctp_parallel_for(pool, 0U, 10000U, 16U, fill_double,
+                                values) != 0);
+        assert(ctp_get_works_count(pool) == 1U);
+        ctp_clear_queue(pool);
+        atomic_store(&gate, -1);
+
+        ctp_finish(pool, NULL);
+    }
+
+    puts("OK");
+}
+
+static void test21(void)
+{
+    ctpool_t pool;
+    ctp_graph_t graph;
+    unsigned int nodes[5];
+    unsigned int i, run, extra;
+
+    printf("Test21...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+        pool = ctp_init(3U, 0U, 0);
+        assert(pool != NULL);
+
+        graph = ctp_graph_create();
+        assert(graph != NULL);
+        assert(ctp_graph_run(pool, graph) != 0);
+        assert(ctp_graph_wait(graph, 0U) != 0);
+
+        for (i = 0U; i < 5U; i++) {
+            assert(ctp_graph_add(graph, record, (void*)(size_t)i,
+                                 &nodes[i]) != 0);
+        }
+        for (i = 1U; i < 4U; i++) {
+            assert(ctp_graph_depend(graph, nodes[i], nodes[0]) != 0);
+            assert(ctp_graph_depend(graph, nodes[4], nodes[i]) != 0);
+        }
+        assert(ctp_graph_depend(graph, 5U, nodes[0]) == 0);
+
+        for (run = 0U; run < 3U; run++) {
+            calculated = 0U;
+            assert(ctp_graph_run(pool, graph) != 0);
+            assert(ctp_graph_wait(graph, CTP_INFINITE) != 0);
+            assert(calculated == 5U);
+            assert((order[0] == 0U) && (order[4] == 4U));
+        }
+
+        ctp_pause(pool);
+        calculated = 0U;
+        assert(ctp_graph_run(pool, graph) != 0);
+        assert(ctp_graph_wait(graph, 0U) == 0);
+        assert(ctp_graph_run(pool, graph) == 0);
+        assert(ctp_graph_add(graph, record, NULL, &extra) == 0);
+        ctp_resume(pool);
+        assert(ctp_graph_wait(graph, CTP_INFINITE) != 0);
+        assert(calculated == 5U);
+
+        assert(ctp_graph_depend(graph, nodes[0], nodes[4]) != 0);
+        assert(ctp_graph_run(pool, graph) == 0);
+
+        ctp_graph_destroy(graph);
+        ctp_finish(pool, NULL);
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test22(void)
+{
+    ctpool_t pool;
+    ctp_timer_t timers[100];
+    ctp_timer_t periodic;
+    struct timespec when;
+    unsigned int i, cancelled, ticks;
+    int lock_free;
+
+    printf("Test22...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (lock_free = 0; lock_free < 2; lock_free++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.lock_free = lock_free;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            for (i = 0U; i < 100U; i++) {
+                timers[i] = ctp_add_work_after(pool, 50U + (i % 50U), inc,
+                                               NULL);
+                assert(timers[i] != 0U);
+            }
+            cancelled = 0U;
+            for (i = 0U; i < 100U; i += 2U) {
+                if (ctp_timer_cancel(pool, timers[i]) != 0) {
+                    cancelled++;
+                }
+            }
+            assert(cancelled == 50U);
+            assert(ctp_timer_cancel(pool, timers[0]) == 0);
+            assert(ctp_timer_cancel(pool, 0U) == 0);
+
+            sleep_ms(20U);
+            pthread_mutex_lock(&m);
+            assert(calculated == 0U);
+            pthread_mutex_unlock(&m);
+            sleep_ms(200U);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 50U);
+            assert(ctp_timer_cancel(pool, timers[1]) == 0);
+
+            clock_gettime(CLOCK_MONOTONIC, &when);
+            assert(ctp_add_work_at(pool, &when, inc, NULL) != 0U);
+            sleep_ms(50U);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 51U);
+
+            assert(ctp_add_work_every(pool, 0U, inc, NULL) == 0U);
+            periodic = ctp_add_work_every(pool, 10U, inc, NULL);
+            assert(periodic != 0U);
+            sleep_ms(205U);
+            assert(ctp_timer_cancel(pool, periodic) != 0);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            ticks = calculated - 51U;
+            assert((ticks >= 10U) && (ticks <= 21U));
+            sleep_ms(50U);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == (51U + ticks));
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test23(void)
+{
+    ctpool_t pool;
+    int client_a, client_b;
+    unsigned int i, mode;
+
+    printf("Test23...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (mode = 0U; mode < 3U; mode++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.queue_size = 64U;
+            options.unbounded = (mode == 1U) ? -1 : 0;
+            options.lock_free = (mode == 2U) ? -1 : 0;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            ctp_pause(pool);
+            for (i = 0U; i < 60U; i++) {
+                const void* const tag = ((i % 3U) == 0U) ? (void*)&client_a
+                                      : (((i % 3U) == 1U) ? (void*)&client_b
+                                                          : NULL);
+                assert(ctp_add_work_tagged(pool, tag, inc, NULL) != 0);
+            }
+
+            if (mode < 2U) {
+                assert(ctp_cancel_tag(pool, &client_a) == 20U);
+                assert(ctp_cancel_tag(pool, &client_a) == 0U);
+                assert(ctp_cancel_tag(pool, NULL) == 0U);
+                assert(ctp_get_works_count(pool) == 60U);
+            }
+            else {
+                assert(ctp_cancel_tag(pool, &client_a) == 0U);
+            }
+
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == ((mode < 2U) ? 40U : 60U));
+            assert(ctp_cancel_tag(pool, &client_b) == 0U);
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test24(void)
+{
+    static const unsigned int sizes[5] = { 4U, 32U, 100U, 600U,
+                                           CTP_MAX_PAYLOAD };
+    ctpool_t pool;
+    unsigned char payload[CTP_MAX_PAYLOAD + 1U];
+    unsigned int i, mode;
+
+    printf("Test24...");
+    for (i = 0U; i < sizeof(payload); i++) {
+        payload[i] = (unsigned char)i;
+    }
+
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (mode = 0U; mode < 3U; mode++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 4U;
+            options.queue_size = 256U;
+            options.block = -1;
+            options.lock_free = (mode == 1U) ? -1 : 0;
+            options.work_stealing = (mode == 2U) ? -1 : 0;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            for (i = 0U; i < 5000U; i++) {
+                const unsigned int size = sizes[i % 5U];
+                memcpy(payload, &size, sizeof(size));
+                assert(ctp_add_work_payload(pool, check_payload, payload,
+                                            size) != 0);
+            }
+            assert(ctp_add_work_payload(pool, check_payload, payload,
+                                        CTP_MAX_PAYLOAD + 1U) == 0);
+            atomic_store(&empty_payloads, 0U);
+            assert(ctp_add_work_payload(pool, count_empty, NULL, 0U) != 0);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 5000U);
+            assert(atomic_load(&empty_payloads) == 1U);
+
+            ctp_pause(pool);
+            for (i = 0U; i < 100U; i++) {
+                const unsigned int size = sizes[i % 5U];
+                memcpy(payload, &size, sizeof(size));
+                assert(ctp_add_work_payload(pool, check_payload, payload,
+                                            size) != 0);
+            }
+            ctp_clear_queue(pool);
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 5000U);
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test25(void)
+{
+    ctpool_t pool;
+    pthread_t self = pthread_self();
+    unsigned int i, mode;
+
+    printf("Test25...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+
+        for (mode = 0U; mode < 4U; mode++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 1U;
+            options.queue_size = 4U;
+            options.caller_runs = -1;
+            options.unbounded = (mode == 1U) ? -1 : 0;
+            options.queue_memory_cap = 1U;
+            options.lock_free = (mode >= 2U) ? -1 : 0;
+            options.work_stealing = (mode == 3U) ? -1 : 0;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            fib_sum = 0U;
+            assert(ctp_add_work(pool, nap, NULL) != 0);
+            for (i = 0U; i < 2000U; i++) {
+                assert(ctp_add_work(pool, inc_where, &self) != 0);
+            }
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == 2000U);
+            assert(fib_sum > 0U);
+
+            ctp_pause(pool);
+            i = 0U;
+            while (ctp_add_work(pool, inc_where, &self) != 0) {
+                i++;
+            }
+            assert(i >= 4U);
+            ctp_resume(pool);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(calculated == (2000U + i));
+
+            ctp_finish(pool, NULL);
+        }
+
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test26(void)
+{
+    ctpool_t pool;
+    ctp_strand_t strand;
+    size_t i;
+    unsigned int mode;
+
+    printf("Test26...");
+    for (mode = 0U; mode < 3U; mode++) {
+        ctp_options_t options;
+
+        ctp_options_init(&options);
+        options.threads_num = 4U;
+        options.queue_size = (mode == 2U) ? 2U : 0U;
+        options.lock_free = (mode == 1U) ? -1 : 0;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        strand = ctp_strand_create(pool, 4U);
+        assert(strand != NULL);
+        for (i = 0U; i < 16U; i++) {
+            atomic_store(&in_strand[i], 0U);
+            strand_next[i] = 0U;
+        }
+        for (i = 0U; i < (16U * 500U); i++) {
+            assert(ctp_strand_post_key(strand, i % 16U, strand_step,
+                                       (void*)i) != 0);
+        }
+        assert(ctp_strand_wait(strand, CTP_INFINITE) != 0);
+        for (i = 0U; i < 16U; i++) {
+            assert(strand_next[i] == 500U);
+        }
+        assert(ctp_get_works_count(pool) == 0U);
+        ctp_strand_destroy(strand);
+
+        strand = ctp_strand_create(pool, 0U);
+        assert(strand != NULL);
+        strand_next[3] = 0U;
+        for (i = 0U; i < 1000U; i++) {
+            assert(ctp_strand_post(strand, strand_step,
+                                   (void*)((i * 16U) + 3U)) != 0);
+        }
+        ctp_strand_destroy(strand);
+        assert(strand_next[3] == 1000U);
+
+        ctp_finish(pool, NULL);
+    }
+    puts("OK");
+}
+
+static void test27(void)
+{
+    ctpool_t pool;
+    unsigned int threads = 4U;
+    unsigned int i, mode, spawned;
+
+    printf("Test27...");
+    for (mode = 0U; mode < 3U; mode++) {
+        ctp_options_t options;
+
+        ctp_options_init(&options);
+        options.threads_num = threads;
+        options.block = -1;
+        options.lock_free = (mode > 0U) ? -1 : 0;
+        options.work_stealing = (mode == 2U) ? -1 : 0;
+        options.thread_start = hook_start;
+        options.thread_exit = hook_exit;
+        options.hook_argument = &threads;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        atomic_store(&hook_starts, 0U);
+        atomic_store(&hook_exits, 0U);
+        atomic_store(&hook_total, 0U);
+        for (i = 0U; i < 20000U; i++) {
+            assert(ctp_add_work_ex(pool, count_ex, &threads) != 0);
+        }
+        assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+
+        ctp_finish(pool, &spawned);
+        assert(atomic_load(&hook_starts) == atomic_load(&hook_exits));
+        assert(atomic_load(&hook_starts) >= spawned);
+        assert(atomic_load(&hook_total) == 20000U);
+
+        ctp_options_init(&options);
+        options.threads_num = 2U;
+        options.keep_alive_ms = 10U;
+        options.lock_free = (mode > 0U) ? -1 : 0;
+        options.thread_exit = exit_add;
+        options.hook_argument = &pool;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        atomic_store(&hook_exits, 0U);
+        for (i = 0U; i < 100U; i++) {
+            assert(ctp_add_work(pool, twice, NULL) != 0);
+        }
+        while (atomic_load(&hook_exits) < 5U) {
+            sleep_ms(1U);
+        }
+        ctp_finish(pool, NULL);
+    }
+    puts("OK");
+}
+
+static void test28(void)
+{
+    ctpool_t pool;
+    ctp_completion_t done[64];
+    struct pollfd pfd;
+    size_t i, seen;
+    unsigned int mode, n;
+
+    printf("Test28...");
+    pool = ctp_init(2U, 0U, -1);
+    assert(pool != NULL);
+    assert(ctp_get_completion_fd(pool) < 0);
+    assert(ctp_add_work_notify(pool, twice, NULL) == 0);
+    ctp_finish(pool, NULL);
+
+    for (mode = 0U; mode < 2U; mode++) {
+        ctp_options_t options;
+
+        ctp_options_init(&options);
+        options.threads_num = 4U;
+        options.block = -1;
+        options.lock_free = (mode == 1U) ? -1 : 0;
+        options.completions = -1;
+        pool = ctp_init_ex(&options);
+        assert(pool != NULL);
+
+        pfd.fd = ctp_get_completion_fd(pool);
+        pfd.events = POLLIN;
+        assert(pfd.fd >= 0);
+        assert(poll(&pfd, 1U, 0) == 0);
+        assert(ctp_drain_completions(pool, done, 64U) == 0U);
+
+        fib_sum = 0U;
+        for (i = 1U; i <= 5000U; i++) {
+            assert(ctp_add_work_notify(pool, twice, (void*)i) != 0);
+        }
+
+        seen = 0U;
+        while (seen < 5000U) {
+            assert(poll(&pfd, 1U, 5000) == 1);
+            do {
+                n = ctp_drain_completions(pool, done, 64U);
+                for (i = 0U; i < n; i++) {
+                    assert((size_t)done[i].result
+                           == ((size_t)done[i].argument * 2U));
+                    fib_sum += (size_t)done[i].argument;
+                }
+                seen += n;
+            } while (n == 64U);
+        }
+        assert(fib_sum == ((5000U * 5001U) / 2U));
+        assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+        assert(ctp_drain_completions(pool, done, 64U) == 0U);
+        assert(poll(&pfd, 1U, 0) == 0);
+
+        ctp_finish(pool, NULL);
+    }
+    puts("OK");
+}
+
+static void test29(void)
+{
+    unsigned int target = 1000U;
+    unsigned int i, mode;
+
+    printf("Test29...");
+    if (pthread_mutex_init(&m, NULL) == 0) {
+        blocking_pool = ctp_init(2U, 0U, -1);
+        assert(blocking_pool != NULL);
+        ctp_blocking_begin(blocking_pool);
+        ctp_blocking_end(blocking_pool);
+        calculated = 0U;
+        assert(ctp_add_work_blocking(blocking_pool, inc, NULL) != 0);
+        ctp_finish(blocking_pool, NULL);
+        assert(calculated == 1U);
+
+        for (mode = 0U; mode < 2U; mode++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 2U;
+            options.block = -1;
+            options.lock_free = (mode == 1U) ? -1 : 0;
+            options.blocking_threads = 2U;
+            blocking_pool = ctp_init_ex(&options);
+            assert(blocking_pool != NULL);
+
+            calculated = 0U;
+            fib_sum = 0U;
+            for (i = 0U; i < 2U; i++) {
+                assert(ctp_add_work(blocking_pool, blocker, &target) != 0);
+            }
+            for (i = 0U; i < target; i++) {
+                assert(ctp_add_work(blocking_pool, inc, NULL) != 0);
+            }
+            for (i = 0U; i < 4U; i++) {
+                assert(ctp_add_work_blocking(blocking_pool, nap, NULL) != 0);
+            }
+            assert(ctp_wait_idle(blocking_pool, CTP_INFINITE) != 0);
+            assert(fib_sum == 2U);
+            assert(calculated == target);
+
+            for (i = 0U; i < 8U; i++) {
+                assert(ctp_add_work_blocking(blocking_pool, inc, NULL) != 0);
+            }
+            ctp_finish(blocking_pool, NULL);
+            assert(calculated == (target + 8U));
+        }
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+static void test30(void)
+{
+    ctpool_t pool;
+    pthread_t producers[4];
+    pthread_t killer;
+    pthread_t self = pthread_self();
+    struct sigaction action;
+    struct timespec start, end;
+    unsigned int i, mode;
+    long elapsed;
+
+    printf("Test30...");
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    if (pthread_mutex_init(&m, NULL) == 0) {
+        for (mode = 0U; mode < 2U; mode++) {
+            ctp_options_t options;
+
+            ctp_options_init(&options);
+            options.threads_num = 1U;
+            options.queue_size = 64U;
+            options.block = -1;
+            options.lock_free = (mode == 1U) ? -1 : 0;
+            options.high_watermark = 16U;
+            options.low_watermark = 4U;
+            options.watermark = on_watermark;
+            options.watermark_argument = &pool;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            atomic_store(&gate, 0);
+            atomic_store(&marks_high, 0U);
+            atomic_store(&marks_low, 0U);
+            assert(ctp_add_work(pool, wait_gate, NULL) != 0);
+            for (i = 0U; i < 30U; i++) {
+                assert(ctp_add_work(pool, inc, NULL) != 0);
+            }
+            assert(atomic_load(&marks_high) == 1U);
+            assert(atomic_load(&marks_low) == 0U);
+
+            atomic_store(&gate, -1);
+            assert(ctp_wait_idle(pool, CTP_INFINITE) != 0);
+            assert(atomic_load(&marks_high) == 1U);
+            assert(atomic_load(&marks_low) == 1U);
+            ctp_finish(pool, NULL);
+
+            options.threads_num = 2U;
+            options.queue_size = 16U;
+            options.high_watermark = 3U;
+            options.low_watermark = 2U;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            atomic_store(&marks_high, 0U);
+            atomic_store(&marks_low, 0U);
+            for (i = 0U; i < 4U; i++) {
+                assert(pthread_create(&producers[i], NULL, produce, &pool)
+                       == 0);
+            }
+            for (i = 0U; i < 4U; i++) {
+                pthread_join(producers[i], NULL);
+            }
+            ctp_finish(pool, NULL);
+            assert(atomic_load(&marks_high) > 0U);
+            assert(atomic_load(&marks_high) == atomic_load(&marks_low));
+
+            ctp_options_init(&options);
+            options.threads_num = 1U;
+            options.queue_size = 2U;
+            options.lock_free = (mode == 1U) ? -1 : 0;
+            pool = ctp_init_ex(&options);
+            assert(pool != NULL);
+
+            calculated = 0U;
+            assert(ctp_add_work(pool, nap, NULL) != 0);
+            while (ctp_get_works_count(pool) > 0U) {
+                sleep_ms(1U);
+            }
+            i = 0U;
+            while (ctp_add_work(pool, inc, NULL) != 0) {
+                i++;
+            }
+            assert(ctp_add_work_timed(pool, inc, NULL, 0U) == 0);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            assert(ctp_add_work_timed(pool, inc, NULL, 5000U) == 0);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            elapsed = ((long)(end.tv_sec - start.tv_sec) * 1000000L)
+                      + ((end.tv_nsec - start.tv_nsec) / 1000L);
+            assert(elapsed >= 4000L);
+            assert(pthread_create(&killer, NULL, interrupt, &self) == 0);
+            assert(ctp_add_work_timed(pool, inc, NULL, 5000000U) != 0);
+            pthread_join(killer, NULL);
+            ctp_finish(pool, NULL);
+            assert(calculated == (i + 1U));
+        }
+        puts("OK");
+        pthread_mutex_destroy(&m);
+    }
+}
+
+int main(void)
+{
+    srand((unsigned int)time(NULL));
+
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+    test20();
+    test21();
+    test22();
+    test23();
+    test24();
+    test25();
+    test26();
+    test27();
+    test28();
+    test29();
+    test30();
+
+    puts("\npool done");
+
+    return 0;
+}